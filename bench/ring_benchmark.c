@@ -0,0 +1,108 @@
+// Compares the mutex guarded Ring the database worker used to be fed
+// through with the lock-free Channel that replaced it.
+//
+//     cmake . && make ring_benchmark && ./ring_benchmark [ENTRIES]
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "channel.h"
+#include "ring.h"
+#include "tinycthread.h"
+
+static Ring ring;
+static mtx_t mtx;
+static cnd_t cnd;
+static Channel channel;
+static long consumed;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int ring_consumer(void *arg) {
+    RingEntry e;
+    do {
+        mtx_lock(&mtx);
+        while (!ring_get(&ring, &e)) {
+            cnd_wait(&cnd, &mtx);
+        }
+        mtx_unlock(&mtx);
+        consumed++;
+    } while (e.type != EXIT);
+    return 0;
+}
+
+static int channel_consumer(void *arg) {
+    RingEntry e;
+    do {
+        channel_wait(&channel);
+        while (!channel_get(&channel, &e));
+        consumed++;
+    } while (e.type != EXIT);
+    return 0;
+}
+
+static void report(const char *name, long entries, double put, double total) {
+    printf("%-8s put %7.1f ns/entry  drained %6.2f M entries/s\n",
+        name, put * 1e9 / entries, entries / total / 1e6);
+}
+
+static void bench_ring(long entries) {
+    ring_alloc(&ring, 1024);
+    mtx_init(&mtx, mtx_plain);
+    cnd_init(&cnd);
+    consumed = 0;
+    thrd_t thrd;
+    double start = now();
+    thrd_create(&thrd, ring_consumer, NULL);
+    for (long i = 0; i < entries; i++) {
+        mtx_lock(&mtx);
+        ring_put_block(&ring, 0, 0, i & 31, (i >> 5) & 255, 0, 1);
+        cnd_signal(&cnd);
+        mtx_unlock(&mtx);
+    }
+    mtx_lock(&mtx);
+    ring_put_exit(&ring);
+    cnd_signal(&cnd);
+    mtx_unlock(&mtx);
+    double put = now() - start;
+    thrd_join(thrd, NULL);
+    report("ring", entries, put, now() - start);
+    cnd_destroy(&cnd);
+    mtx_destroy(&mtx);
+    ring_free(&ring);
+}
+
+static void bench_channel(long entries) {
+    channel_alloc(&channel);
+    consumed = 0;
+    thrd_t thrd;
+    double start = now();
+    thrd_create(&thrd, channel_consumer, NULL);
+    RingEntry e = {BLOCK, 0, 0, 0, 0, 0, 1, 0};
+    for (long i = 0; i < entries; i++) {
+        e.x = i & 31;
+        e.y = (i >> 5) & 255;
+        channel_put(&channel, &e);
+    }
+    e.type = EXIT;
+    channel_put(&channel, &e);
+    double put = now() - start;
+    thrd_join(thrd, NULL);
+    report("channel", entries, put, now() - start);
+    channel_free(&channel);
+}
+
+int main(int argc, char **argv) {
+    long entries = argc > 1 ? atol(argv[1]) : 4 * 1024 * 1024;
+    for (int i = 0; i < 3; i++) {
+        bench_ring(entries);
+        bench_channel(entries);
+    }
+    return 0;
+}
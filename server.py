@@ -258,6 +258,18 @@ class Model(object):
         ]
         for query in queries:
             self.execute(query)
+        version = list(self.execute('pragma user_version;'))[0][0]
+        if version < 1:
+            # chunks used to store copies of their neighbours' edge blocks,
+            # the highest rowid is kept so rowids are never handed out again
+            query = (
+                'delete from block where '
+                '(x < p * :size or x >= (p + 1) * :size or '
+                'z < q * :size or z >= (q + 1) * :size) and '
+                'rowid < (select max(rowid) from block);'
+            )
+            self.execute(query, dict(size=CHUNK_SIZE))
+            self.execute('pragma user_version = 1;')
     def get_default_block(self, x, y, z):
         p, q = chunked(x), chunked(z)
         chunk = self.world.get_chunk(p, q)
@@ -414,9 +426,7 @@ class Model(object):
                     continue
                 if dz and chunked(z + dz) == q:
                     continue
-                np, nq = p + dx, q + dz
-                self.execute(query, dict(p=np, q=nq, x=x, y=y, z=z, w=-w))
-                self.send_block(client, np, nq, x, y, z, -w)
+                self.send_redraw(client, p + dx, q + dz)
         if w == 0:
             query = (
                 'delete from sign where '
@@ -594,6 +604,11 @@ class Model(object):
                 continue
             other.send(BLOCK, p, q, x, y, z, w)
             other.send(REDRAW, p, q)
+    def send_redraw(self, client, p, q):
+        for other in self.clients:
+            if other == client:
+                continue
+            other.send(REDRAW, p, q)
     def send_light(self, client, p, q, x, y, z, w):
         for other in self.clients:
             if other == client:
@@ -1,12 +1,13 @@
 #version 120
+#extension GL_EXT_texture_array : enable
 
-uniform sampler2D sampler;
+uniform sampler2DArray sampler;
 uniform sampler2D sky_sampler;
 uniform float timer;
 uniform float daylight;
 uniform int ortho;
 
-varying vec2 fragment_uv;
+varying vec3 fragment_uv;
 varying float fragment_ao;
 varying float fragment_light;
 varying float fog_factor;
@@ -16,10 +17,11 @@ varying float diffuse;
 const float pi = 3.14159265;
 
 void main() {
-    vec3 color = vec3(texture2D(sampler, fragment_uv));
-    if (color == vec3(1.0, 0.0, 1.0)) {
+    vec4 texel = texture2DArray(sampler, fragment_uv);
+    if (texel.a < 0.5) {
         discard;
     }
+    vec3 color = vec3(texel);
     bool cloud = color == vec3(1.0, 1.0, 1.0);
     if (cloud && bool(ortho)) {
         discard;
@@ -9,7 +9,7 @@ attribute vec4 position;
 attribute vec3 normal;
 attribute vec4 uv;
 
-varying vec2 fragment_uv;
+varying vec3 fragment_uv;
 varying float fragment_ao;
 varying float fragment_light;
 varying float fog_factor;
@@ -21,7 +21,8 @@ const vec3 light_direction = normalize(vec3(-1.0, 1.0, -1.0));
 
 void main() {
     gl_Position = matrix * position;
-    fragment_uv = uv.xy;
+    float layer = floor(uv.y * 0.5 + 0.25);
+    fragment_uv = vec3(uv.x, uv.y - layer * 2.0, layer);
     fragment_ao = 0.3 + (1.0 - uv.z) * 0.7;
     fragment_light = uv.w;
     diffuse = max(0.0, dot(normal, light_direction));
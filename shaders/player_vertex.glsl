@@ -0,0 +1,61 @@
+#version 120
+
+uniform mat4 matrix;
+uniform vec3 camera;
+uniform float fog_distance;
+uniform int ortho;
+
+attribute vec4 position;
+attribute vec3 normal;
+attribute vec4 uv;
+attribute vec3 offset;
+attribute vec2 rotation;
+
+varying vec3 fragment_uv;
+varying float fragment_ao;
+varying float fragment_light;
+varying float fog_factor;
+varying float fog_height;
+varying float diffuse;
+
+const float pi = 3.14159265;
+const vec3 light_direction = normalize(vec3(-1.0, 1.0, -1.0));
+
+mat3 rotate(vec3 axis, float angle) {
+    float s = sin(angle);
+    float c = cos(angle);
+    float m = 1.0 - c;
+    float x = axis.x;
+    float y = axis.y;
+    float z = axis.z;
+    return mat3(
+        m * x * x + c, m * x * y - z * s, m * z * x + y * s,
+        m * x * y + z * s, m * y * y + c, m * y * z - x * s,
+        m * z * x - y * s, m * y * z + x * s, m * z * z + c);
+}
+
+void main() {
+    float rx = rotation.x;
+    float ry = rotation.y;
+    mat3 model =
+        rotate(vec3(cos(rx), 0.0, sin(rx)), -ry) *
+        rotate(vec3(0.0, 1.0, 0.0), rx);
+    vec3 world = model * vec3(position) + offset;
+    gl_Position = matrix * vec4(world, 1.0);
+    float layer = floor(uv.y * 0.5 + 0.25);
+    fragment_uv = vec3(uv.x, uv.y - layer * 2.0, layer);
+    fragment_ao = 0.3 + (1.0 - uv.z) * 0.7;
+    fragment_light = uv.w;
+    diffuse = max(0.0, dot(model * normal, light_direction));
+    if (bool(ortho)) {
+        fog_factor = 0.0;
+        fog_height = 0.0;
+    }
+    else {
+        float camera_distance = distance(camera, world);
+        fog_factor = pow(clamp(camera_distance / fog_distance, 0.0, 1.0), 4.0);
+        float dy = world.y - camera.y;
+        float dx = distance(world.xz, camera.xz);
+        fog_height = (atan(dy, dx) + pi / 2) / pi;
+    }
+}
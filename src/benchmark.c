@@ -0,0 +1,160 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "benchmark.h"
+#include "config.h"
+
+typedef struct {
+    float x, y, z, rx, ry;
+} Waypoint;
+
+// the camera moves between waypoints at a fixed step per frame so every
+// build renders exactly the same sequence of views
+static const Waypoint waypoints[] = {
+    {0, 48, 0, 0, -0.2},
+    {0, 48, -256, 0.5, -0.2},
+    {-192, 64, -448, 1.5, -0.4},
+    {-448, 56, -448, 3.1, -0.1},
+    {-448, 40, -128, 4.0, -0.3},
+    {-128, 48, 64, 6.3, -0.2}
+};
+
+static double *frame_times;
+static int frame_count;
+static long long face_total;
+static int face_max;
+static double *chunk_times;
+static int chunk_count;
+static int chunk_capacity;
+static int active;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(double *sorted, int count, double p) {
+    if (!count) {
+        return 0;
+    }
+    int index = (int)ceil(p * count) - 1;
+    index = index < 0 ? 0 : index;
+    return sorted[index];
+}
+
+static double mean(double *data, int count) {
+    double total = 0;
+    for (int i = 0; i < count; i++) {
+        total += data[i];
+    }
+    return count ? total / count : 0;
+}
+
+static void write_stats(FILE *file, double *data, int count) {
+    qsort(data, count, sizeof(double), cmp_double);
+    fprintf(file,
+        "{\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, "
+        "\"p99\": %.3f, \"max\": %.3f}",
+        mean(data, count),
+        percentile(data, count, 0.5),
+        percentile(data, count, 0.9),
+        percentile(data, count, 0.99),
+        count ? data[count - 1] : 0);
+}
+
+static void write_string(FILE *file, const char *str) {
+    fputc('"', file);
+    for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(file, "\\%c", *c);
+        }
+        else if (*c < 0x20) {
+            fprintf(file, "\\u%04x", *c);
+        }
+        else {
+            fputc(*c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+void benchmark_start() {
+    free(frame_times);
+    free(chunk_times);
+    frame_times = calloc(BENCHMARK_FRAMES, sizeof(double));
+    frame_count = 0;
+    face_total = 0;
+    face_max = 0;
+    chunk_capacity = 1024;
+    chunk_times = calloc(chunk_capacity, sizeof(double));
+    chunk_count = 0;
+    active = 1;
+}
+
+int benchmark_path(int frame, float *x, float *y, float *z, float *rx, float *ry) {
+    int segments = sizeof(waypoints) / sizeof(Waypoint) - 1;
+    if (frame >= BENCHMARK_FRAMES) {
+        return 0;
+    }
+    float t = (float)frame / BENCHMARK_FRAMES * segments;
+    int i = (int)t;
+    t -= i;
+    const Waypoint *a = waypoints + i;
+    const Waypoint *b = waypoints + i + 1;
+    *x = a->x + (b->x - a->x) * t;
+    *y = a->y + (b->y - a->y) * t;
+    *z = a->z + (b->z - a->z) * t;
+    *rx = a->rx + (b->rx - a->rx) * t;
+    *ry = a->ry + (b->ry - a->ry) * t;
+    return 1;
+}
+
+void benchmark_frame(double frame_ms, int faces) {
+    if (!active || frame_count >= BENCHMARK_FRAMES) {
+        return;
+    }
+    frame_times[frame_count++] = frame_ms;
+    face_total += faces;
+    face_max = faces > face_max ? faces : face_max;
+}
+
+void benchmark_chunk(double latency_ms) {
+    if (!active) {
+        return;
+    }
+    if (chunk_count == chunk_capacity) {
+        chunk_capacity *= 2;
+        chunk_times = realloc(chunk_times, chunk_capacity * sizeof(double));
+    }
+    chunk_times[chunk_count++] = latency_ms;
+}
+
+int benchmark_write(const char *path, const char *renderer) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return 0;
+    }
+    double duration = 0;
+    for (int i = 0; i < frame_count; i++) {
+        duration += frame_times[i];
+    }
+    fprintf(file, "{\n");
+    fprintf(file, "    \"renderer\": ");
+    write_string(file, renderer ? renderer : "");
+    fprintf(file, ",\n");
+    fprintf(file, "    \"frames\": %d,\n", frame_count);
+    fprintf(file, "    \"duration_s\": %.3f,\n", duration / 1000);
+    fprintf(file, "    \"frame_ms\": ");
+    write_stats(file, frame_times, frame_count);
+    fprintf(file, ",\n");
+    fprintf(file, "    \"faces\": {\"mean\": %.1f, \"max\": %d},\n",
+        frame_count ? (double)face_total / frame_count : 0, face_max);
+    fprintf(file, "    \"chunks\": %d,\n", chunk_count);
+    fprintf(file, "    \"chunk_ready_ms\": ");
+    write_stats(file, chunk_times, chunk_count);
+    fprintf(file, "\n}\n");
+    fclose(file);
+    active = 0;
+    return 1;
+}
@@ -0,0 +1,10 @@
+#ifndef _benchmark_h_
+#define _benchmark_h_
+
+void benchmark_start();
+int benchmark_path(int frame, float *x, float *y, float *z, float *rx, float *ry);
+void benchmark_frame(double frame_ms, int faces);
+void benchmark_chunk(double latency_ms);
+int benchmark_write(const char *path, const char *renderer);
+
+#endif
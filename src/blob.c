@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <string.h>
+#include "blob.h"
+
+// Edits are stored as a palette of the distinct block ids followed by
+// runs over the cells in y, z, x order:
+//
+//     version, palette size, palette ids..., (run length, palette index)...
+//
+// Sizes and run lengths are varints and palette index 0 means no edit.
+// Edits are sparse and usually come in rows, so a chunk that took
+// thousands of rows in the block table is typically a few hundred bytes.
+
+static int put_varint(unsigned char *data, unsigned int value) {
+    int n = 0;
+    while (value >= 0x80) {
+        data[n++] = (value & 0x7f) | 0x80;
+        value >>= 7;
+    }
+    data[n++] = value;
+    return n;
+}
+
+static int get_varint(
+    const unsigned char *data, int size, int *offset, unsigned int *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 32 && *offset < size; shift += 7) {
+        unsigned char byte = data[(*offset)++];
+        *value |= (unsigned int)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int cell_index(Blob *blob, int x, int y, int z) {
+    x -= blob->p * CHUNK_SIZE - 1;
+    z -= blob->q * CHUNK_SIZE - 1;
+    if (x < 0 || x >= BLOB_WIDTH || z < 0 || z >= BLOB_WIDTH) {
+        return -1;
+    }
+    if (y < 0 || y >= BLOB_HEIGHT) {
+        return -1;
+    }
+    return (y * BLOB_WIDTH + z) * BLOB_WIDTH + x;
+}
+
+void blob_alloc(Blob *blob, int p, int q) {
+    blob->p = p;
+    blob->q = q;
+    blob->cells = calloc(BLOB_CELLS, sizeof(unsigned short));
+}
+
+void blob_free(Blob *blob) {
+    free(blob->cells);
+}
+
+void blob_set(Blob *blob, int x, int y, int z, int w) {
+    if (x < blob->p * CHUNK_SIZE || x >= (blob->p + 1) * CHUNK_SIZE ||
+        z < blob->q * CHUNK_SIZE || z >= (blob->q + 1) * CHUNK_SIZE)
+    {
+        return;
+    }
+    int index = cell_index(blob, x, y, z);
+    if (index >= 0) {
+        blob->cells[index] = (w & 0xff) + 1;
+    }
+}
+
+int blob_get(Blob *blob, int index, int *x, int *y, int *z, int *w) {
+    if (!blob->cells[index]) {
+        return 0;
+    }
+    *x = index % BLOB_WIDTH + blob->p * CHUNK_SIZE - 1;
+    *z = index / BLOB_WIDTH % BLOB_WIDTH + blob->q * CHUNK_SIZE - 1;
+    *y = index / (BLOB_WIDTH * BLOB_WIDTH);
+    *w = (signed char)(blob->cells[index] - 1);
+    return 1;
+}
+
+int blob_encode(Blob *blob, unsigned char **data) {
+    unsigned short palette[257] = {0};
+    int ids[256];
+    int count = 0;
+    for (int i = 0; i < BLOB_CELLS; i++) {
+        int cell = blob->cells[i];
+        if (cell && !palette[cell]) {
+            ids[count] = cell - 1;
+            palette[cell] = ++count;
+        }
+    }
+    // worst case every cell alternates, at most 3 + 2 bytes per cell
+    unsigned char *out = malloc(4 + count * 2 + BLOB_CELLS * 5);
+    int n = 0;
+    out[n++] = BLOB_VERSION;
+    n += put_varint(out + n, count);
+    for (int i = 0; i < count; i++) {
+        out[n++] = ids[i];
+    }
+    int start = 0;
+    while (start < BLOB_CELLS) {
+        int index = palette[blob->cells[start]];
+        int end = start + 1;
+        while (end < BLOB_CELLS && palette[blob->cells[end]] == index) {
+            end++;
+        }
+        n += put_varint(out + n, end - start);
+        n += put_varint(out + n, index);
+        start = end;
+    }
+    *data = realloc(out, n);
+    return n;
+}
+
+// unlike blob_set this keeps the border, the chunk cache stores whole maps
+int blob_encode_map(Map *map, int p, int q, unsigned char **data) {
+    Blob blob;
+    blob_alloc(&blob, p, q);
+    MAP_FOR_EACH(map, ex, ey, ez, ew) {
+        int index = cell_index(&blob, ex, ey, ez);
+        if (index >= 0) {
+            blob.cells[index] = (ew & 0xff) + 1;
+        }
+    } END_MAP_FOR_EACH;
+    int size = blob_encode(&blob, data);
+    blob_free(&blob);
+    return size;
+}
+
+// calls func for every edit in the encoded data, returns 0 if it is corrupt
+static int blob_walk(
+    const unsigned char *data, int size, int p, int q,
+    void (*func)(void *arg, int x, int y, int z, int w), void *arg)
+{
+    if (size < 2 || data[0] != BLOB_VERSION) {
+        return 0;
+    }
+    int offset = 1;
+    unsigned int count;
+    if (!get_varint(data, size, &offset, &count) || count > 256 ||
+        offset + (int)count > size)
+    {
+        return 0;
+    }
+    const unsigned char *ids = data + offset;
+    offset += count;
+    int ox = p * CHUNK_SIZE - 1;
+    int oz = q * CHUNK_SIZE - 1;
+    unsigned int cell = 0;
+    while (offset < size) {
+        unsigned int length, index;
+        if (!get_varint(data, size, &offset, &length) ||
+            !get_varint(data, size, &offset, &index) ||
+            index > count || length > BLOB_CELLS - cell)
+        {
+            return 0;
+        }
+        if (!index) {
+            cell += length;
+            continue;
+        }
+        int w = (signed char)ids[index - 1];
+        for (unsigned int end = cell + length; cell < end; cell++) {
+            int x = cell % BLOB_WIDTH + ox;
+            int z = cell / BLOB_WIDTH % BLOB_WIDTH + oz;
+            int y = cell / (BLOB_WIDTH * BLOB_WIDTH);
+            func(arg, x, y, z, w);
+        }
+    }
+    return 1;
+}
+
+static void set_blob_cell(void *arg, int x, int y, int z, int w) {
+    blob_set((Blob *)arg, x, y, z, w);
+}
+
+static void set_map_cell(void *arg, int x, int y, int z, int w) {
+    map_set((Map *)arg, x, y, z, w);
+}
+
+int blob_decode(Blob *blob, const unsigned char *data, int size) {
+    return blob_walk(data, size, blob->p, blob->q, set_blob_cell, blob);
+}
+
+// the load path goes straight into the chunk's map without a dense copy
+int blob_load_map(Map *map, int p, int q, const unsigned char *data, int size) {
+    return blob_walk(data, size, p, q, set_map_cell, map);
+}
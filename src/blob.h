@@ -0,0 +1,29 @@
+#ifndef _blob_h_
+#define _blob_h_
+
+#include "config.h"
+#include "map.h"
+
+// a chunk's block edits, the layout keeps a one block border that used to
+// hold copies of the neighbours' edge blocks and is now always empty
+#define BLOB_WIDTH (CHUNK_SIZE + 2)
+#define BLOB_HEIGHT 256
+#define BLOB_CELLS (BLOB_WIDTH * BLOB_WIDTH * BLOB_HEIGHT)
+#define BLOB_VERSION 1
+
+typedef struct {
+    int p;
+    int q;
+    unsigned short *cells; // 0 for no edit, otherwise (w & 0xff) + 1
+} Blob;
+
+void blob_alloc(Blob *blob, int p, int q);
+void blob_free(Blob *blob);
+void blob_set(Blob *blob, int x, int y, int z, int w);
+int blob_get(Blob *blob, int index, int *x, int *y, int *z, int *w);
+int blob_encode(Blob *blob, unsigned char **data);
+int blob_decode(Blob *blob, const unsigned char *data, int size);
+int blob_encode_map(Map *map, int p, int q, unsigned char **data);
+int blob_load_map(Map *map, int p, int q, const unsigned char *data, int size);
+
+#endif
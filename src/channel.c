@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <string.h>
+#include "channel.h"
+
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#define FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+static ChannelBlock *channel_block() {
+    ChannelBlock *block = malloc(sizeof(ChannelBlock));
+    block->next = 0;
+    return block;
+}
+
+void channel_alloc(Channel *channel) {
+    memset(channel, 0, sizeof(Channel));
+    channel->head = channel->tail = channel_block();
+    mtx_init(&channel->mtx, mtx_plain);
+    cnd_init(&channel->cnd);
+}
+
+void channel_free(Channel *channel) {
+    ChannelBlock *block = channel->head;
+    while (block) {
+        ChannelBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    cnd_destroy(&channel->cnd);
+    mtx_destroy(&channel->mtx);
+}
+
+// the producer grows the channel a block at a time and never waits on the
+// consumer; the new block is published by the store to written
+void channel_put(Channel *channel, RingEntry *entry) {
+    if (channel->tail_count == CHANNEL_BLOCK_SIZE) {
+        ChannelBlock *block = channel_block();
+        channel->tail->next = block;
+        channel->tail = block;
+        channel->tail_count = 0;
+    }
+    RingEntry *e = channel->tail->data + channel->tail_count++;
+    memcpy(e, entry, sizeof(RingEntry));
+    STORE(channel->written, channel->written + 1);
+    FENCE();
+    if (__atomic_load_n(&channel->sleeping, __ATOMIC_RELAXED)) {
+        mtx_lock(&channel->mtx);
+        cnd_signal(&channel->cnd);
+        mtx_unlock(&channel->mtx);
+    }
+}
+
+int channel_get(Channel *channel, RingEntry *entry) {
+    if (channel->consumed == LOAD(channel->written)) {
+        return 0;
+    }
+    if (channel->head_count == CHANNEL_BLOCK_SIZE) {
+        ChannelBlock *block = channel->head;
+        channel->head = block->next;
+        channel->head_count = 0;
+        free(block);
+    }
+    RingEntry *e = channel->head->data + channel->head_count++;
+    memcpy(entry, e, sizeof(RingEntry));
+    channel->consumed++;
+    return 1;
+}
+
+// only the consumer sleeps, after spinning for a while, and the producer
+// only takes the lock to wake it when it has announced that it is about to
+void channel_wait(Channel *channel) {
+    for (int i = 0; i < CHANNEL_SPIN; i++) {
+        if (channel->consumed != LOAD(channel->written)) {
+            return;
+        }
+        thrd_yield();
+    }
+    mtx_lock(&channel->mtx);
+    __atomic_store_n(&channel->sleeping, 1, __ATOMIC_RELAXED);
+    FENCE();
+    while (channel->consumed == LOAD(channel->written)) {
+        cnd_wait(&channel->cnd, &channel->mtx);
+    }
+    __atomic_store_n(&channel->sleeping, 0, __ATOMIC_RELAXED);
+    mtx_unlock(&channel->mtx);
+}
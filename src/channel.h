@@ -0,0 +1,38 @@
+#ifndef _channel_h_
+#define _channel_h_
+
+#include "ring.h"
+#include "tinycthread.h"
+
+#define CHANNEL_BLOCK_SIZE 4096
+#define CHANNEL_CACHE_LINE 64
+#define CHANNEL_SPIN 64
+
+typedef struct ChannelBlock {
+    struct ChannelBlock *next;
+    RingEntry data[CHANNEL_BLOCK_SIZE];
+} ChannelBlock;
+
+// single producer, single consumer; the producer side and the consumer
+// side each live on their own cache line
+typedef struct {
+    ChannelBlock *tail;
+    int tail_count;
+    unsigned int written;
+    char producer_pad[CHANNEL_CACHE_LINE];
+    ChannelBlock *head;
+    int head_count;
+    unsigned int consumed;
+    char consumer_pad[CHANNEL_CACHE_LINE];
+    int sleeping;
+    mtx_t mtx;
+    cnd_t cnd;
+} Channel;
+
+void channel_alloc(Channel *channel);
+void channel_free(Channel *channel);
+void channel_put(Channel *channel, RingEntry *entry);
+int channel_get(Channel *channel, RingEntry *entry);
+void channel_wait(Channel *channel);
+
+#endif
@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include "math.h"
 #include "matrix.h"
+#include "profile.h"
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -23,6 +24,7 @@ void create_clouds() {
     weather->initial_generation = MAXIMUM_CLOUDS;
 
     weather->cloud_count = 0;
+    weather->cloud_limit = MAXIMUM_CLOUDS;
     weather->clouds = (Cloud**)malloc(MAXIMUM_CLOUDS * sizeof(Cloud*));
 
     GLfloat *data = malloc(sizeof(GLfloat) * 6 * 9 * 6);
@@ -195,7 +197,7 @@ void add_cloud(float player_x, float player_z, float rx, float rz){
     //certain types of weather will force less clouds to be allowed.
     int weather_cloud_max_modifier = 0;
 
-    if (weather->cloud_count < MAXIMUM_CLOUDS - weather_cloud_max_modifier) {
+    if (weather->cloud_count < weather->cloud_limit - weather_cloud_max_modifier) {
         Cloud *c = (Cloud*)malloc(sizeof(Cloud));
 
         c->hmWidth = 32;
@@ -284,6 +286,7 @@ void render_cloud(Cloud *cloud, CloudAttrib *attrib){
                 mat_scale(matrix, 1, heightval, 1);
                 glUniformMatrix4fv(attrib->model, 1, GL_FALSE, matrix);
                 glDrawArrays(GL_TRIANGLES, 0, 36);
+                profile_draw(1);
                 mat_translate_existing(matrix, 0, -up, 0);
                 mat_scale(matrix, 1, 1.0f/heightval, 1);
             }
@@ -293,14 +296,12 @@ void render_cloud(Cloud *cloud, CloudAttrib *attrib){
     glUniformMatrix4fv(attrib->model, 1, GL_FALSE, matrix_prev);
 }
 
-void render_clouds(CloudAttrib *attrib, int width, int height, float x, float y, float z, float rx, float ry, float fov, int ortho, int radius) {
+void render_clouds(CloudAttrib *attrib, float *matrix, float x, float y, float z, float ry) {
     int i;
     if(!(ry > -0.444 || y > CLOUD_Y_HEIGHT)){
         return;
     }
 
-    float matrix[16];
-    set_matrix_3d(matrix, width, height, x, y, z, rx, ry, fov, ortho, radius);
     glUseProgram(attrib->program);
     glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
     glUniform3f(attrib->camera, x, y, z);
@@ -347,3 +348,11 @@ void cleanup_clouds() {
     free(weather->clouds);
     free(weather);
 }
+
+void set_cloud_limit(int limit) {
+    weather->cloud_limit = limit;
+    while (weather->cloud_count > limit) {
+        weather->cloud_count--;
+        remove_cloud(weather->clouds[weather->cloud_count]);
+    }
+}
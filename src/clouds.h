@@ -22,6 +22,7 @@ typedef struct {
     float x_prevailing_winds;
     float z_prevailing_winds;
     int cloud_count;
+    int cloud_limit;
     Cloud **clouds;
     int initial_generation;
     int cloud_vertex_buffer;
@@ -46,8 +47,9 @@ Weather *weather;
 
 void create_clouds();
 void update_clouds(float x, float y, float z, float rx, float rz, float fov);
-void render_clouds(CloudAttrib *attrib, int width, int height, float x, float y, float z, float rx, float ry, float fov, int ortho, int radius);
+void render_clouds(CloudAttrib *attrib, float *matrix, float x, float y, float z, float ry);
 void cleanup_clouds();
+void set_cloud_limit(int limit);
 
 void remove_cloud(Cloud *c);
 void add_cloud(float player_x, float player_z, float rx, float rz);
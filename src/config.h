@@ -11,13 +11,20 @@
 #define MAX_MESSAGES 4
 #define DB_PATH "craft.db"
 #define USE_CACHE 1
+#define CACHE_LIMIT_MB 256
+#define CACHE_TOUCH_INTERVAL 60
+#define USE_SHADER_CACHE 1
+#define USE_CHUNK_BLOBS 0
 #define DAY_LENGTH 600
 #define INVERT_MOUSE 0
 #define PLAYER_NAME_DISTANCE 96
+#define BENCHMARK_DB_PATH "benchmark.db"
+#define BENCHMARK_FRAMES 1800
 
 // rendering options
 #define SHOW_LIGHTS 1
 #define SHOW_PLANTS 1
+#define FAST_LEAVES 1
 #define SHOW_CLOUDS 1
 #define SHOW_TREES 1
 #define SHOW_ITEM 1
@@ -26,6 +33,8 @@
 #define SHOW_INFO_TEXT 1
 #define SHOW_CHAT_TEXT 1
 #define SHOW_PLAYER_NAMES 1
+#define SHOW_PROFILE 0
+#define GOVERNOR 0
 
 // key bindings
 #define CRAFT_KEY_FORWARD 'W'
@@ -43,14 +52,42 @@
 #define CRAFT_KEY_CHAT 't'
 #define CRAFT_KEY_COMMAND '/'
 #define CRAFT_KEY_SIGN '`'
+#define CRAFT_KEY_PROFILE GLFW_KEY_F3
 
 // advanced parameters
 #define CREATE_CHUNK_RADIUS 10
 #define RENDER_CHUNK_RADIUS 10
 #define RENDER_SIGN_RADIUS 4
+#define PLANT_CHUNK_RADIUS 6
+#define PLANT_THINNING 1
 #define DELETE_CHUNK_RADIUS 14
+#define PREFETCH_SECONDS 4
+#define PREFETCH_MAX_SPEED 100
+#define PREFETCH_CHUNK_LIMIT 256
+#define PREFETCH_BURST_RADIUS 2
+#define LOD_CHUNK_RADIUS 8
+#define LOD_STEP 4
 #define CHUNK_SIZE 32
 #define COMMIT_INTERVAL 5
+#define DB_BATCH_SIZE 4096
+#define DB_INSERT_ROWS 64
+#define DB_ASSERT_THREAD 0
+#define CHUNK_CACHE_BYTES (64 * 1024 * 1024)
+#define CHUNK_CACHE_COMPRESS 0
+#define CHUNK_FREEZE_RATE 8
+#define UPLOAD_BUDGET_MS 4
+#define UPLOAD_BUDGET_BYTES (4 * 1024 * 1024)
+
+// frame time governor
+#define GOVERNOR_TARGET_MS 16
+#define GOVERNOR_INTERVAL 1
+#define GOVERNOR_SHRINK_RATIO 1.2
+#define GOVERNOR_GROW_RATIO 0.7
+#define GOVERNOR_SHRINK_WINDOWS 2
+#define GOVERNOR_GROW_WINDOWS 5
+#define GOVERNOR_COOLDOWN 2
+#define GOVERNOR_MAX_BACKLOG 8
+#define GOVERNOR_MIN_RADIUS 4
 
 #define CLOUD_Y_HEIGHT 80
 #define MAXIMUM_CLOUDS 100
@@ -51,17 +51,12 @@ void make_cube_faces(
         {0, 2, 1, 2, 3, 1}
     };
     float *d = data;
-    float s = 0.0625;
-    float a = 0 + 1 / 2048.0;
-    float b = s - 1 / 2048.0;
     int faces[6] = {left, right, top, bottom, front, back};
     int tiles[6] = {wleft, wright, wtop, wbottom, wfront, wback};
     for (int i = 0; i < 6; i++) {
         if (faces[i] == 0) {
             continue;
         }
-        float du = (tiles[i] % 16) * s;
-        float dv = (tiles[i] / 16) * s;
         int flip = ao[i][0] + ao[i][3] > ao[i][1] + ao[i][2];
         for (int v = 0; v < 6; v++) {
             int j = flip ? flipped[i][v] : indices[i][v];
@@ -71,8 +66,8 @@ void make_cube_faces(
             *(d++) = normals[i][0];
             *(d++) = normals[i][1];
             *(d++) = normals[i][2];
-            *(d++) = du + (uvs[i][j][0] ? b : a);
-            *(d++) = dv + (uvs[i][j][1] ? b : a);
+            *(d++) = uvs[i][j][0];
+            *(d++) = TILE_V(tiles[i], uvs[i][j][1]);
             *(d++) = ao[i][j];
             *(d++) = light[i][j];
         }
@@ -101,6 +96,24 @@ void make_cube(
         x, y, z, n);
 }
 
+void make_box(
+    float *data, float ao[6][4], float light[6][4],
+    int left, int right, int top, int bottom, int front, int back,
+    float x1, float y1, float z1, float x2, float y2, float z2, int w)
+{
+    make_cube(
+        data, ao, light,
+        left, right, top, bottom, front, back,
+        0, 0, 0, 1, w);
+    int count = (left + right + top + bottom + front + back) * 6;
+    for (int i = 0; i < count; i++) {
+        float *d = data + i * 10;
+        d[0] = d[0] < 0 ? x1 : x2;
+        d[1] = d[1] < 0 ? y1 : y2;
+        d[2] = d[2] < 0 ? z1 : z2;
+    }
+}
+
 void make_plant(
     float *data, float ao, float light,
     float px, float py, float pz, float n, int w, float rotation)
@@ -130,12 +143,8 @@ void make_plant(
         {0, 3, 1, 0, 2, 3}
     };
     float *d = data;
-    float s = 0.0625;
-    float a = 0;
-    float b = s;
     struct item_list *plant = get_item_by_id(ABS(w));
-    float du = (plant->tile->sprite % 16) * s;
-    float dv = (plant->tile->sprite / 16) * s;
+    int tile = plant->tile->sprite;
     for (int i = 0; i < 4; i++) {
         for (int v = 0; v < 6; v++) {
             int j = indices[i][v];
@@ -145,8 +154,8 @@ void make_plant(
             *(d++) = normals[i][0];
             *(d++) = normals[i][1];
             *(d++) = normals[i][2];
-            *(d++) = du + (uvs[i][j][0] ? b : a);
-            *(d++) = dv + (uvs[i][j][1] ? b : a);
+            *(d++) = uvs[i][j][0];
+            *(d++) = TILE_V(tile, uvs[i][j][1]);
             *(d++) = ao;
             *(d++) = light;
         }
@@ -1,6 +1,10 @@
 #ifndef _cube_h_
 #define _cube_h_
 
+// block vertices carry the atlas layer in v: v = tile * 2 + local v, so
+// both the layer and the local coordinate survive interpolation
+#define TILE_V(tile, v) ((tile) * 2 + (v))
+
 void make_cube_faces(
     float *data, float ao[6][4], float light[6][4],
     int left, int right, int top, int bottom, int front, int back,
@@ -12,6 +16,11 @@ void make_cube(
     int left, int right, int top, int bottom, int front, int back,
     float x, float y, float z, float n, int w);
 
+void make_box(
+    float *data, float ao[6][4], float light[6][4],
+    int left, int right, int top, int bottom, int front, int back,
+    float x1, float y1, float z1, float x2, float y2, float z2, int w);
+
 void make_plant(
     float *data, float ao, float light,
     float px, float py, float pz, float n, int w, float rotation);
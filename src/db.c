@@ -1,28 +1,110 @@
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "blob.h"
+#include "config.h"
 #include "db.h"
-#include "ring.h"
+#include "channel.h"
 #include "sqlite3.h"
 #include "tinycthread.h"
 
+#define LOAD_BLOCKS_QUERY "select x, y, z, w from block where p = ? and q = ?;"
+#define LOAD_LIGHTS_QUERY "select x, y, z, w from light where p = ? and q = ?;"
+#define LOAD_SIGNS_QUERY \
+    "select x, y, z, face, text from sign where p = ? and q = ?;"
+#define LOAD_CHUNK_QUERY "select data from chunk where p = ? and q = ?;"
+#define HAS_BLOCKS_QUERY "select 1 from block where p = ? and q = ? limit 1;"
+#define HAS_CHUNK_QUERY "select 1 from chunk where p = ? and q = ?;"
+
+// chunk loads read through their own connection each, so with the
+// database in WAL mode they run alongside each other and the writer
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *load_blocks_stmt;
+    sqlite3_stmt *load_lights_stmt;
+    sqlite3_stmt *load_signs_stmt;
+    sqlite3_stmt *load_chunk_stmt;
+    sqlite3_stmt *has_blocks_stmt;
+} Reader;
+
 static int db_enabled = 0;
 
 static sqlite3 *db;
 static sqlite3_stmt *insert_block_stmt;
 static sqlite3_stmt *insert_light_stmt;
+static sqlite3_stmt *insert_blocks_stmt;
+static sqlite3_stmt *insert_lights_stmt;
+static sqlite3_stmt *read_chunk_stmt;
+static sqlite3_stmt *save_chunk_stmt;
 static sqlite3_stmt *insert_sign_stmt;
 static sqlite3_stmt *delete_sign_stmt;
 static sqlite3_stmt *delete_signs_stmt;
 static sqlite3_stmt *load_blocks_stmt;
-static sqlite3_stmt *load_lights_stmt;
-static sqlite3_stmt *load_signs_stmt;
 static sqlite3_stmt *get_key_stmt;
 static sqlite3_stmt *set_key_stmt;
+static sqlite3_stmt *touch_chunk_stmt;
+static sqlite3_stmt *tracked_chunk_stmt;
+static sqlite3_stmt *oldest_chunks_stmt;
+static sqlite3_stmt *evict_stmts[6];
+static double cache_limit;
 
-static Ring ring;
+// producers are serialised by the model lock, so a single-producer
+// channel is enough to feed the worker
+static Channel channel;
+static Channel completions;
+static thrd_t watched;
+static int watching;
+static Reader *readers;
+static int reader_count;
 static thrd_t thrd;
 static mtx_t mtx;
-static cnd_t cnd;
-static mtx_t load_mtx;
+
+// writes drained from the channel, coalesced by table and position so only
+// the last write to each block, light or key survives a batch
+static RingEntry batch[DB_BATCH_SIZE];
+static RingEntry writes[DB_BATCH_SIZE];
+static int write_count;
+static int write_slots[DB_BATCH_SIZE * 2];
+static int write_coalesced;
+static int uncommitted;
+static int coalesced_count;
+static int written_count;
+static double write_seconds;
+
+static void put_entry(
+    RingEntryType type, int p, int q, int x, int y, int z, int w)
+{
+    RingEntry entry;
+    entry.type = type;
+    entry.p = p;
+    entry.q = q;
+    entry.x = x;
+    entry.y = y;
+    entry.z = z;
+    entry.w = w;
+    entry.key = w;
+    channel_put(&channel, &entry);
+}
+
+// with DB_ASSERT_THREAD set, SQLite calls made on the thread that turned
+// the check on are fatal; the render thread turns it on for its frames
+static void check_thread(const char *name) {
+    if (DB_ASSERT_THREAD && watching && thrd_equal(thrd_current(), watched)) {
+        fprintf(stderr, "%s: SQLite call on the render thread\n", name);
+        abort();
+    }
+}
+
+void db_assert_thread(int enabled) {
+    watched = thrd_current();
+    watching = enabled;
+}
+
+// in bytes, 0 leaves the database unbounded
+void db_cache_limit(int megabytes) {
+    cache_limit = megabytes * 1024.0 * 1024.0;
+}
 
 void db_enable() {
     db_enabled = 1;
@@ -36,7 +118,223 @@ int get_db_enabled() {
     return db_enabled;
 }
 
-int db_init(char *path) {
+static void make_insert_query(char *query, const char *table, int rows) {
+    query += sprintf(
+        query, "insert or replace into %s (p, q, x, y, z, w) values ", table);
+    for (int i = 0; i < rows; i++) {
+        query += sprintf(query, "%s(?, ?, ?, ?, ?, ?)", i ? ", " : "");
+    }
+}
+
+static void read_blob(Blob *blob) {
+    sqlite3_reset(read_chunk_stmt);
+    sqlite3_bind_int(read_chunk_stmt, 1, blob->p);
+    sqlite3_bind_int(read_chunk_stmt, 2, blob->q);
+    if (sqlite3_step(read_chunk_stmt) == SQLITE_ROW) {
+        blob_decode(
+            blob, sqlite3_column_blob(read_chunk_stmt, 0),
+            sqlite3_column_bytes(read_chunk_stmt, 0));
+    }
+    sqlite3_reset(read_chunk_stmt);
+}
+
+static void save_blob(Blob *blob) {
+    unsigned char *data;
+    int size = blob_encode(blob, &data);
+    sqlite3_reset(save_chunk_stmt);
+    sqlite3_bind_int(save_chunk_stmt, 1, blob->p);
+    sqlite3_bind_int(save_chunk_stmt, 2, blob->q);
+    sqlite3_bind_blob(save_chunk_stmt, 3, data, size, SQLITE_TRANSIENT);
+    sqlite3_step(save_chunk_stmt);
+    free(data);
+}
+
+static void migrate_to_blobs() {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(
+        db, "select distinct p, q from block;", -1, &stmt, NULL);
+    sqlite3_exec(db, "begin;", NULL, NULL, NULL);
+    int count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Blob blob;
+        blob_alloc(
+            &blob, sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1));
+        read_blob(&blob);
+        sqlite3_reset(load_blocks_stmt);
+        sqlite3_bind_int(load_blocks_stmt, 1, blob.p);
+        sqlite3_bind_int(load_blocks_stmt, 2, blob.q);
+        while (sqlite3_step(load_blocks_stmt) == SQLITE_ROW) {
+            blob_set(&blob,
+                sqlite3_column_int(load_blocks_stmt, 0),
+                sqlite3_column_int(load_blocks_stmt, 1),
+                sqlite3_column_int(load_blocks_stmt, 2),
+                sqlite3_column_int(load_blocks_stmt, 3));
+        }
+        save_blob(&blob);
+        blob_free(&blob);
+        count++;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_exec(db, "delete from block; commit;", NULL, NULL, NULL);
+    if (count) {
+        printf("Migrated %d chunks to the chunk table\n", count);
+    }
+}
+
+static void migrate_to_rows() {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(
+        db, "select p, q, data from chunk;", -1, &stmt, NULL);
+    sqlite3_exec(db, "begin;", NULL, NULL, NULL);
+    int count = 0;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        Blob blob;
+        blob_alloc(
+            &blob, sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1));
+        blob_decode(
+            &blob, sqlite3_column_blob(stmt, 2), sqlite3_column_bytes(stmt, 2));
+        for (int i = 0; i < BLOB_CELLS; i++) {
+            int x, y, z, w;
+            if (blob_get(&blob, i, &x, &y, &z, &w)) {
+                sqlite3_reset(insert_block_stmt);
+                sqlite3_bind_int(insert_block_stmt, 1, blob.p);
+                sqlite3_bind_int(insert_block_stmt, 2, blob.q);
+                sqlite3_bind_int(insert_block_stmt, 3, x);
+                sqlite3_bind_int(insert_block_stmt, 4, y);
+                sqlite3_bind_int(insert_block_stmt, 5, z);
+                sqlite3_bind_int(insert_block_stmt, 6, w);
+                sqlite3_step(insert_block_stmt);
+            }
+        }
+        blob_free(&blob);
+        count++;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_exec(db, "delete from chunk; commit;", NULL, NULL, NULL);
+    if (count) {
+        printf("Migrated %d chunks to the block table\n", count);
+    }
+}
+
+// chunks used to store copies of their neighbours' edge blocks, the mesher
+// reads those from the neighbours now so the copies are dropped once
+static void strip_borders() {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(db, "pragma user_version;", -1, &stmt, NULL);
+    int version = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    if (version >= 1) {
+        return;
+    }
+    char query[256];
+    snprintf(query, sizeof(query),
+        "delete from block where "
+        "x < p * %d or x >= (p + 1) * %d or "
+        "z < q * %d or z >= (q + 1) * %d;",
+        CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE);
+    sqlite3_exec(db, "begin;", NULL, NULL, NULL);
+    sqlite3_exec(db, query, NULL, NULL, NULL);
+    int rows = sqlite3_changes(db);
+    // blob_set drops the border cells, so a round trip strips a blob
+    int count = 0;
+    int capacity = 64;
+    int *chunks = malloc(sizeof(int) * 2 * capacity);
+    sqlite3_prepare_v2(db, "select p, q from chunk;", -1, &stmt, NULL);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (count == capacity) {
+            capacity *= 2;
+            chunks = realloc(chunks, sizeof(int) * 2 * capacity);
+        }
+        chunks[count * 2] = sqlite3_column_int(stmt, 0);
+        chunks[count * 2 + 1] = sqlite3_column_int(stmt, 1);
+        count++;
+    }
+    sqlite3_finalize(stmt);
+    for (int i = 0; i < count; i++) {
+        Blob blob;
+        blob_alloc(&blob, chunks[i * 2], chunks[i * 2 + 1]);
+        read_blob(&blob);
+        save_blob(&blob);
+        blob_free(&blob);
+    }
+    free(chunks);
+    sqlite3_exec(db, "pragma user_version = 1; commit;", NULL, NULL, NULL);
+    if (rows || count) {
+        printf("Removed %d border rows, rewrote %d chunks\n", rows, count);
+    }
+}
+
+// caches from before access tracking start out as the oldest chunks
+static void track_chunks() {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(
+        db, "select 1 from chunk_access limit 1;", -1, &stmt, NULL);
+    int tracked = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    if (!tracked) {
+        sqlite3_exec(db,
+            "insert or ignore into chunk_access (p, q, time) "
+            "select p, q, 0 from key union "
+            "select distinct p, q, 0 from block;",
+            NULL, NULL, NULL);
+    }
+}
+
+static int pragma_int(const char *query) {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(db, query, -1, &stmt, NULL);
+    int result = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        result = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+// bytes in use, freed pages are reused before the file grows again
+static double cache_size() {
+    double pages =
+        pragma_int("pragma page_count;") -
+        pragma_int("pragma freelist_count;");
+    return pages * pragma_int("pragma page_size;");
+}
+
+static int reader_open(Reader *reader, char *path) {
+    int rc;
+    rc = sqlite3_open_v2(
+        path, &reader->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(reader->db, LOAD_BLOCKS_QUERY, -1,
+        &reader->load_blocks_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(reader->db, LOAD_LIGHTS_QUERY, -1,
+        &reader->load_lights_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(reader->db, LOAD_SIGNS_QUERY, -1,
+        &reader->load_signs_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(reader->db, LOAD_CHUNK_QUERY, -1,
+        &reader->load_chunk_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(reader->db,
+        USE_CHUNK_BLOBS ? HAS_CHUNK_QUERY : HAS_BLOCKS_QUERY, -1,
+        &reader->has_blocks_stmt, NULL);
+    return rc;
+}
+
+static void reader_close(Reader *reader) {
+    sqlite3_finalize(reader->load_blocks_stmt);
+    sqlite3_finalize(reader->load_lights_stmt);
+    sqlite3_finalize(reader->load_signs_stmt);
+    sqlite3_finalize(reader->load_chunk_stmt);
+    sqlite3_finalize(reader->has_blocks_stmt);
+    sqlite3_close(reader->db);
+}
+
+int db_init(char *path, int reader_threads) {
     if (!db_enabled) {
         return 0;
     }
@@ -77,6 +375,16 @@ int db_init(char *path) {
         "    q int not null,"
         "    key int not null"
         ");"
+        "create table if not exists chunk ("
+        "    p int not null,"
+        "    q int not null,"
+        "    data blob not null"
+        ");"
+        "create table if not exists chunk_access ("
+        "    p int not null,"
+        "    q int not null,"
+        "    time int not null"
+        ");"
         "create table if not exists sign ("
         "    p int not null,"
         "    q int not null,"
@@ -89,6 +397,11 @@ int db_init(char *path) {
         "create unique index if not exists block_pqxyz_idx on block (p, q, x, y, z);"
         "create unique index if not exists light_pqxyz_idx on light (p, q, x, y, z);"
         "create unique index if not exists key_pq_idx on key (p, q);"
+        "create unique index if not exists chunk_pq_idx on chunk (p, q);"
+        "create unique index if not exists chunk_access_pq_idx"
+        "    on chunk_access (p, q);"
+        "create index if not exists chunk_access_time_idx"
+        "    on chunk_access (time);"
         "create unique index if not exists sign_xyzface_idx on sign (x, y, z, face);"
         "create index if not exists sign_pq_idx on sign (p, q);";
     static const char *insert_block_query =
@@ -104,20 +417,44 @@ int db_init(char *path) {
         "delete from sign where x = ? and y = ? and z = ? and face = ?;";
     static const char *delete_signs_query =
         "delete from sign where x = ? and y = ? and z = ?;";
-    static const char *load_blocks_query =
-        "select x, y, z, w from block where p = ? and q = ?;";
-    static const char *load_lights_query =
-        "select x, y, z, w from light where p = ? and q = ?;";
-    static const char *load_signs_query =
-        "select x, y, z, face, text from sign where p = ? and q = ?;";
+    static const char *save_chunk_query =
+        "insert or replace into chunk (p, q, data) values (?, ?, ?);";
     static const char *get_key_query =
         "select key from key where p = ? and q = ?;";
     static const char *set_key_query =
         "insert or replace into key (p, q, key) "
         "values (?, ?, ?);";
+    // an evicted chunk gets no key until it is requested again, otherwise
+    // the server would only resend what changed since the eviction
+    static const char *set_cached_key_query =
+        "insert or replace into key (p, q, key) "
+        "select ?1, ?2, ?3 where exists ("
+        "    select 1 from chunk_access where p = ?1 and q = ?2);";
+    static const char *touch_chunk_query =
+        "insert or replace into chunk_access (p, q, time) values (?, ?, ?);";
+    static const char *tracked_chunk_query =
+        "select 1 from chunk_access where p = ? and q = ?;";
+    static const char *oldest_chunks_query =
+        "select p, q from chunk_access order by time limit 8;";
+    static const char *evict_queries[6] = {
+        "delete from block where p = ? and q = ?;",
+        "delete from light where p = ? and q = ?;",
+        "delete from sign where p = ? and q = ?;",
+        "delete from key where p = ? and q = ?;",
+        "delete from chunk where p = ? and q = ?;",
+        "delete from chunk_access where p = ? and q = ?;"
+    };
+    char insert_blocks_query[64 + DB_INSERT_ROWS * 20];
+    char insert_lights_query[64 + DB_INSERT_ROWS * 20];
+    make_insert_query(insert_blocks_query, "block", DB_INSERT_ROWS);
+    make_insert_query(insert_lights_query, "light", DB_INSERT_ROWS);
     int rc;
     rc = sqlite3_open(path, &db);
     if (rc) return rc;
+    rc = sqlite3_exec(
+        db, "pragma journal_mode = wal; pragma synchronous = normal;",
+        NULL, NULL, NULL);
+    if (rc) return rc;
     rc = sqlite3_exec(db, create_query, NULL, NULL, NULL);
     if (rc) return rc;
     rc = sqlite3_prepare_v2(
@@ -126,6 +463,12 @@ int db_init(char *path) {
     rc = sqlite3_prepare_v2(
         db, insert_light_query, -1, &insert_light_stmt, NULL);
     if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        db, insert_blocks_query, -1, &insert_blocks_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        db, insert_lights_query, -1, &insert_lights_stmt, NULL);
+    if (rc) return rc;
     rc = sqlite3_prepare_v2(
         db, insert_sign_query, -1, &insert_sign_stmt, NULL);
     if (rc) return rc;
@@ -135,16 +478,48 @@ int db_init(char *path) {
     rc = sqlite3_prepare_v2(
         db, delete_signs_query, -1, &delete_signs_stmt, NULL);
     if (rc) return rc;
-    rc = sqlite3_prepare_v2(db, load_blocks_query, -1, &load_blocks_stmt, NULL);
+    rc = sqlite3_prepare_v2(db, LOAD_BLOCKS_QUERY, -1, &load_blocks_stmt, NULL);
     if (rc) return rc;
-    rc = sqlite3_prepare_v2(db, load_lights_query, -1, &load_lights_stmt, NULL);
+    rc = sqlite3_prepare_v2(db, LOAD_CHUNK_QUERY, -1, &read_chunk_stmt, NULL);
     if (rc) return rc;
-    rc = sqlite3_prepare_v2(db, load_signs_query, -1, &load_signs_stmt, NULL);
+    rc = sqlite3_prepare_v2(db, save_chunk_query, -1, &save_chunk_stmt, NULL);
     if (rc) return rc;
     rc = sqlite3_prepare_v2(db, get_key_query, -1, &get_key_stmt, NULL);
     if (rc) return rc;
-    rc = sqlite3_prepare_v2(db, set_key_query, -1, &set_key_stmt, NULL);
+    rc = sqlite3_prepare_v2(
+        db, cache_limit ? set_cached_key_query : set_key_query, -1,
+        &set_key_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        db, touch_chunk_query, -1, &touch_chunk_stmt, NULL);
+    if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        db, tracked_chunk_query, -1, &tracked_chunk_stmt, NULL);
     if (rc) return rc;
+    rc = sqlite3_prepare_v2(
+        db, oldest_chunks_query, -1, &oldest_chunks_stmt, NULL);
+    if (rc) return rc;
+    for (int i = 0; i < 6; i++) {
+        rc = sqlite3_prepare_v2(
+            db, evict_queries[i], -1, evict_stmts + i, NULL);
+        if (rc) return rc;
+    }
+    if (cache_limit) {
+        track_chunks();
+    }
+    strip_borders();
+    if (USE_CHUNK_BLOBS) {
+        migrate_to_blobs();
+    }
+    else {
+        migrate_to_rows();
+    }
+    reader_count = reader_threads;
+    readers = calloc(reader_count, sizeof(Reader));
+    for (int i = 0; i < reader_count; i++) {
+        rc = reader_open(readers + i, path);
+        if (rc) return rc;
+    }
     sqlite3_exec(db, "begin;", NULL, NULL, NULL);
     db_worker_start();
     return 0;
@@ -158,14 +533,26 @@ void db_close() {
     sqlite3_exec(db, "commit;", NULL, NULL, NULL);
     sqlite3_finalize(insert_block_stmt);
     sqlite3_finalize(insert_light_stmt);
+    sqlite3_finalize(insert_blocks_stmt);
+    sqlite3_finalize(insert_lights_stmt);
     sqlite3_finalize(insert_sign_stmt);
     sqlite3_finalize(delete_sign_stmt);
     sqlite3_finalize(delete_signs_stmt);
     sqlite3_finalize(load_blocks_stmt);
-    sqlite3_finalize(load_lights_stmt);
-    sqlite3_finalize(load_signs_stmt);
+    sqlite3_finalize(read_chunk_stmt);
+    sqlite3_finalize(save_chunk_stmt);
     sqlite3_finalize(get_key_stmt);
     sqlite3_finalize(set_key_stmt);
+    sqlite3_finalize(touch_chunk_stmt);
+    sqlite3_finalize(tracked_chunk_stmt);
+    sqlite3_finalize(oldest_chunks_stmt);
+    for (int i = 0; i < 6; i++) {
+        sqlite3_finalize(evict_stmts[i]);
+    }
+    for (int i = 0; i < reader_count; i++) {
+        reader_close(readers + i);
+    }
+    free(readers);
     sqlite3_close(db);
 }
 
@@ -173,20 +560,19 @@ void db_commit() {
     if (!db_enabled) {
         return;
     }
-    mtx_lock(&mtx);
-    ring_put_commit(&ring);
-    cnd_signal(&cnd);
-    mtx_unlock(&mtx);
+    put_entry(COMMIT, 0, 0, 0, 0, 0, 0);
 }
 
 void _db_commit() {
     sqlite3_exec(db, "commit; begin;", NULL, NULL, NULL);
+    uncommitted = 0;
 }
 
 void db_auth_set(char *username, char *identity_token) {
     if (!db_enabled) {
         return;
     }
+    check_thread(__func__);
     static const char *query =
         "insert or replace into auth.identity_token "
         "(username, token, selected) values (?, ?, ?);";
@@ -204,6 +590,7 @@ int db_auth_select(char *username) {
     if (!db_enabled) {
         return 0;
     }
+    check_thread(__func__);
     db_auth_select_none();
     static const char *query =
         "update auth.identity_token set selected = 1 where username = ?;";
@@ -219,6 +606,7 @@ void db_auth_select_none() {
     if (!db_enabled) {
         return;
     }
+    check_thread(__func__);
     sqlite3_exec(db, "update auth.identity_token set selected = 0;",
         NULL, NULL, NULL);
 }
@@ -230,6 +618,7 @@ int db_auth_get(
     if (!db_enabled) {
         return 0;
     }
+    check_thread(__func__);
     static const char *query =
         "select token from auth.identity_token "
         "where username = ?;";
@@ -254,6 +643,7 @@ int db_auth_get_selected(
     if (!db_enabled) {
         return 0;
     }
+    check_thread(__func__);
     static const char *query =
         "select username, token from auth.identity_token "
         "where selected = 1;";
@@ -277,6 +667,7 @@ void db_save_state(float x, float y, float z, float rx, float ry) {
     if (!db_enabled) {
         return;
     }
+    check_thread(__func__);
     static const char *query =
         "insert into state (x, y, z, rx, ry) values (?, ?, ?, ?, ?);";
     sqlite3_stmt *stmt;
@@ -295,6 +686,7 @@ int db_load_state(float *x, float *y, float *z, float *rx, float *ry) {
     if (!db_enabled) {
         return 0;
     }
+    check_thread(__func__);
     static const char *query =
         "select x, y, z, rx, ry from state;";
     int result = 0;
@@ -316,42 +708,14 @@ void db_insert_block(int p, int q, int x, int y, int z, int w) {
     if (!db_enabled) {
         return;
     }
-    mtx_lock(&mtx);
-    ring_put_block(&ring, p, q, x, y, z, w);
-    cnd_signal(&cnd);
-    mtx_unlock(&mtx);
-}
-
-void _db_insert_block(int p, int q, int x, int y, int z, int w) {
-    sqlite3_reset(insert_block_stmt);
-    sqlite3_bind_int(insert_block_stmt, 1, p);
-    sqlite3_bind_int(insert_block_stmt, 2, q);
-    sqlite3_bind_int(insert_block_stmt, 3, x);
-    sqlite3_bind_int(insert_block_stmt, 4, y);
-    sqlite3_bind_int(insert_block_stmt, 5, z);
-    sqlite3_bind_int(insert_block_stmt, 6, w);
-    sqlite3_step(insert_block_stmt);
+    put_entry(BLOCK, p, q, x, y, z, w);
 }
 
 void db_insert_light(int p, int q, int x, int y, int z, int w) {
     if (!db_enabled) {
         return;
     }
-    mtx_lock(&mtx);
-    ring_put_light(&ring, p, q, x, y, z, w);
-    cnd_signal(&cnd);
-    mtx_unlock(&mtx);
-}
-
-void _db_insert_light(int p, int q, int x, int y, int z, int w) {
-    sqlite3_reset(insert_light_stmt);
-    sqlite3_bind_int(insert_light_stmt, 1, p);
-    sqlite3_bind_int(insert_light_stmt, 2, q);
-    sqlite3_bind_int(insert_light_stmt, 3, x);
-    sqlite3_bind_int(insert_light_stmt, 4, y);
-    sqlite3_bind_int(insert_light_stmt, 5, z);
-    sqlite3_bind_int(insert_light_stmt, 6, w);
-    sqlite3_step(insert_light_stmt);
+    put_entry(LIGHT, p, q, x, y, z, w);
 }
 
 void db_insert_sign(
@@ -360,21 +724,33 @@ void db_insert_sign(
     if (!db_enabled) {
         return;
     }
+    RingEntry entry = {SIGN, p, q, x, y, z, face};
+    entry.text = malloc(strlen(text) + 1);
+    strcpy(entry.text, text);
+    channel_put(&channel, &entry);
+}
+
+void _db_insert_sign(RingEntry *e) {
     sqlite3_reset(insert_sign_stmt);
-    sqlite3_bind_int(insert_sign_stmt, 1, p);
-    sqlite3_bind_int(insert_sign_stmt, 2, q);
-    sqlite3_bind_int(insert_sign_stmt, 3, x);
-    sqlite3_bind_int(insert_sign_stmt, 4, y);
-    sqlite3_bind_int(insert_sign_stmt, 5, z);
-    sqlite3_bind_int(insert_sign_stmt, 6, face);
-    sqlite3_bind_text(insert_sign_stmt, 7, text, -1, NULL);
+    sqlite3_bind_int(insert_sign_stmt, 1, e->p);
+    sqlite3_bind_int(insert_sign_stmt, 2, e->q);
+    sqlite3_bind_int(insert_sign_stmt, 3, e->x);
+    sqlite3_bind_int(insert_sign_stmt, 4, e->y);
+    sqlite3_bind_int(insert_sign_stmt, 5, e->z);
+    sqlite3_bind_int(insert_sign_stmt, 6, e->w);
+    sqlite3_bind_text(insert_sign_stmt, 7, e->text, -1, NULL);
     sqlite3_step(insert_sign_stmt);
+    free(e->text);
 }
 
 void db_delete_sign(int x, int y, int z, int face) {
     if (!db_enabled) {
         return;
     }
+    put_entry(DELETE_SIGN, 0, 0, x, y, z, face);
+}
+
+void _db_delete_sign(int x, int y, int z, int face) {
     sqlite3_reset(delete_sign_stmt);
     sqlite3_bind_int(delete_sign_stmt, 1, x);
     sqlite3_bind_int(delete_sign_stmt, 2, y);
@@ -387,6 +763,10 @@ void db_delete_signs(int x, int y, int z) {
     if (!db_enabled) {
         return;
     }
+    put_entry(DELETE_SIGNS, 0, 0, x, y, z, 0);
+}
+
+void _db_delete_signs(int x, int y, int z) {
     sqlite3_reset(delete_signs_stmt);
     sqlite3_bind_int(delete_signs_stmt, 1, x);
     sqlite3_bind_int(delete_signs_stmt, 2, y);
@@ -398,84 +778,131 @@ void db_delete_all_signs() {
     if (!db_enabled) {
         return;
     }
+    check_thread(__func__);
     sqlite3_exec(db, "delete from sign;", NULL, NULL, NULL);
 }
 
-void db_load_blocks(Map *map, int p, int q) {
+// whether the chunk has any stored blocks, edits or cached server rows
+int db_has_blocks(int p, int q, int reader) {
+    if (!db_enabled) {
+        return 0;
+    }
+    check_thread(__func__);
+    sqlite3_stmt *stmt = readers[reader].has_blocks_stmt;
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 1, p);
+    sqlite3_bind_int(stmt, 2, q);
+    int result = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_reset(stmt);
+    return result;
+}
+
+// reader is the calling thread's own connection, see db_init
+void db_load_blocks(Map *map, int p, int q, int reader) {
     if (!db_enabled) {
         return;
     }
-    mtx_lock(&load_mtx);
-    sqlite3_reset(load_blocks_stmt);
-    sqlite3_bind_int(load_blocks_stmt, 1, p);
-    sqlite3_bind_int(load_blocks_stmt, 2, q);
-    while (sqlite3_step(load_blocks_stmt) == SQLITE_ROW) {
-        int x = sqlite3_column_int(load_blocks_stmt, 0);
-        int y = sqlite3_column_int(load_blocks_stmt, 1);
-        int z = sqlite3_column_int(load_blocks_stmt, 2);
-        int w = sqlite3_column_int(load_blocks_stmt, 3);
+    check_thread(__func__);
+    if (USE_CHUNK_BLOBS) {
+        sqlite3_stmt *stmt = readers[reader].load_chunk_stmt;
+        sqlite3_reset(stmt);
+        sqlite3_bind_int(stmt, 1, p);
+        sqlite3_bind_int(stmt, 2, q);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            blob_load_map(
+                map, p, q, sqlite3_column_blob(stmt, 0),
+                sqlite3_column_bytes(stmt, 0));
+        }
+        // ends the read transaction so an idle worker doesn't hold back
+        // WAL checkpoints
+        sqlite3_reset(stmt);
+        return;
+    }
+    sqlite3_stmt *stmt = readers[reader].load_blocks_stmt;
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 1, p);
+    sqlite3_bind_int(stmt, 2, q);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int x = sqlite3_column_int(stmt, 0);
+        int y = sqlite3_column_int(stmt, 1);
+        int z = sqlite3_column_int(stmt, 2);
+        int w = sqlite3_column_int(stmt, 3);
         map_set(map, x, y, z, w);
     }
-    mtx_unlock(&load_mtx);
 }
 
-void db_load_lights(Map *map, int p, int q) {
+void db_load_lights(Map *map, int p, int q, int reader) {
     if (!db_enabled) {
         return;
     }
-    mtx_lock(&load_mtx);
-    sqlite3_reset(load_lights_stmt);
-    sqlite3_bind_int(load_lights_stmt, 1, p);
-    sqlite3_bind_int(load_lights_stmt, 2, q);
-    while (sqlite3_step(load_lights_stmt) == SQLITE_ROW) {
-        int x = sqlite3_column_int(load_lights_stmt, 0);
-        int y = sqlite3_column_int(load_lights_stmt, 1);
-        int z = sqlite3_column_int(load_lights_stmt, 2);
-        int w = sqlite3_column_int(load_lights_stmt, 3);
+    check_thread(__func__);
+    sqlite3_stmt *stmt = readers[reader].load_lights_stmt;
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 1, p);
+    sqlite3_bind_int(stmt, 2, q);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int x = sqlite3_column_int(stmt, 0);
+        int y = sqlite3_column_int(stmt, 1);
+        int z = sqlite3_column_int(stmt, 2);
+        int w = sqlite3_column_int(stmt, 3);
         map_set(map, x, y, z, w);
     }
-    mtx_unlock(&load_mtx);
 }
 
-void db_load_signs(SignList *list, int p, int q) {
+void db_load_signs(SignList *list, int p, int q, int reader) {
     if (!db_enabled) {
         return;
     }
-    sqlite3_reset(load_signs_stmt);
-    sqlite3_bind_int(load_signs_stmt, 1, p);
-    sqlite3_bind_int(load_signs_stmt, 2, q);
-    while (sqlite3_step(load_signs_stmt) == SQLITE_ROW) {
-        int x = sqlite3_column_int(load_signs_stmt, 0);
-        int y = sqlite3_column_int(load_signs_stmt, 1);
-        int z = sqlite3_column_int(load_signs_stmt, 2);
-        int face = sqlite3_column_int(load_signs_stmt, 3);
-        const char *text = (const char *)sqlite3_column_text(
-            load_signs_stmt, 4);
+    check_thread(__func__);
+    sqlite3_stmt *stmt = readers[reader].load_signs_stmt;
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 1, p);
+    sqlite3_bind_int(stmt, 2, q);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int x = sqlite3_column_int(stmt, 0);
+        int y = sqlite3_column_int(stmt, 1);
+        int z = sqlite3_column_int(stmt, 2);
+        int face = sqlite3_column_int(stmt, 3);
+        const char *text = (const char *)sqlite3_column_text(stmt, 4);
         sign_list_add(list, x, y, z, face, text);
     }
 }
 
-int db_get_key(int p, int q) {
+// the key is looked up on the worker and handed to callback from
+// db_complete, which the simulation thread calls from check_workers
+void db_get_key(int p, int q, db_key_func callback) {
     if (!db_enabled) {
-        return 0;
+        callback(p, q, 0);
+        return;
     }
-    sqlite3_reset(get_key_stmt);
-    sqlite3_bind_int(get_key_stmt, 1, p);
-    sqlite3_bind_int(get_key_stmt, 2, q);
-    if (sqlite3_step(get_key_stmt) == SQLITE_ROW) {
-        return sqlite3_column_int(get_key_stmt, 0);
+    RingEntry entry = {GET_KEY, p, q};
+    entry.callback = callback;
+    channel_put(&channel, &entry);
+}
+
+void db_touch_chunk(int p, int q) {
+    if (!db_enabled) {
+        return;
+    }
+    RingEntry entry = {TOUCH, p, q};
+    channel_put(&channel, &entry);
+}
+
+void db_complete() {
+    if (!db_enabled) {
+        return;
+    }
+    RingEntry e;
+    while (channel_get(&completions, &e)) {
+        e.callback(e.p, e.q, e.key);
     }
-    return 0;
 }
 
 void db_set_key(int p, int q, int key) {
     if (!db_enabled) {
         return;
     }
-    mtx_lock(&mtx);
-    ring_put_key(&ring, p, q, key);
-    cnd_signal(&cnd);
-    mtx_unlock(&mtx);
+    put_entry(KEY, p, q, 0, 0, 0, key);
 }
 
 void _db_set_key(int p, int q, int key) {
@@ -490,10 +917,9 @@ void db_worker_start(char *path) {
     if (!db_enabled) {
         return;
     }
-    ring_alloc(&ring, 1024);
+    channel_alloc(&channel);
+    channel_alloc(&completions);
     mtx_init(&mtx, mtx_plain);
-    mtx_init(&load_mtx, mtx_plain);
-    cnd_init(&cnd);
     thrd_create(&thrd, db_worker_run, path);
 }
 
@@ -501,42 +927,315 @@ void db_worker_stop() {
     if (!db_enabled) {
         return;
     }
-    mtx_lock(&mtx);
-    ring_put_exit(&ring);
-    cnd_signal(&cnd);
-    mtx_unlock(&mtx);
+    put_entry(EXIT, 0, 0, 0, 0, 0, 0);
     thrd_join(thrd, NULL);
-    cnd_destroy(&cnd);
-    mtx_destroy(&load_mtx);
     mtx_destroy(&mtx);
-    ring_free(&ring);
+    channel_free(&channel);
+    channel_free(&completions);
+}
+
+void db_write_stats(int *coalesced, double *rows_per_second) {
+    *coalesced = 0;
+    *rows_per_second = 0;
+    if (!db_enabled) {
+        return;
+    }
+    mtx_lock(&mtx);
+    *coalesced = coalesced_count;
+    *rows_per_second = write_seconds ? written_count / write_seconds : 0;
+    mtx_unlock(&mtx);
+}
+
+static int write_hash(RingEntry *e) {
+    unsigned int h = e->type;
+    h = h * 31 + e->p;
+    h = h * 31 + e->q;
+    if (e->type != KEY) {
+        h = h * 31 + e->x;
+        h = h * 31 + e->y;
+        h = h * 31 + e->z;
+    }
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+    return h & (DB_BATCH_SIZE * 2 - 1);
+}
+
+static int write_equal(RingEntry *a, RingEntry *b) {
+    if (a->type != b->type || a->p != b->p || a->q != b->q) {
+        return 0;
+    }
+    return a->type == KEY || (a->x == b->x && a->y == b->y && a->z == b->z);
+}
+
+static void insert_rows(
+    sqlite3_stmt *multi, sqlite3_stmt *single, RingEntryType type)
+{
+    int n = 0;
+    for (int i = 0; i < write_count; i++) {
+        RingEntry *e = writes + i;
+        if (e->type != type) {
+            continue;
+        }
+        if (n == 0) {
+            sqlite3_reset(multi);
+        }
+        int index = n * 6;
+        sqlite3_bind_int(multi, index + 1, e->p);
+        sqlite3_bind_int(multi, index + 2, e->q);
+        sqlite3_bind_int(multi, index + 3, e->x);
+        sqlite3_bind_int(multi, index + 4, e->y);
+        sqlite3_bind_int(multi, index + 5, e->z);
+        sqlite3_bind_int(multi, index + 6, e->w);
+        if (++n == DB_INSERT_ROWS) {
+            sqlite3_step(multi);
+            n = 0;
+        }
+    }
+    // the tail is too short for the multi-row statement
+    for (int i = write_count - 1; n && i >= 0; i--) {
+        RingEntry *e = writes + i;
+        if (e->type != type) {
+            continue;
+        }
+        sqlite3_reset(single);
+        sqlite3_bind_int(single, 1, e->p);
+        sqlite3_bind_int(single, 2, e->q);
+        sqlite3_bind_int(single, 3, e->x);
+        sqlite3_bind_int(single, 4, e->y);
+        sqlite3_bind_int(single, 5, e->z);
+        sqlite3_bind_int(single, 6, e->w);
+        sqlite3_step(single);
+        n--;
+    }
+}
+
+static int write_compare(const void *a, const void *b) {
+    const RingEntry *e1 = a;
+    const RingEntry *e2 = b;
+    if (e1->type != e2->type) {
+        return e1->type - e2->type;
+    }
+    if (e1->p != e2->p) {
+        return e1->p < e2->p ? -1 : 1;
+    }
+    return e1->q < e2->q ? -1 : (e1->q > e2->q);
+}
+
+// block edits are grouped by chunk and merged into each chunk's blob
+static void save_blobs() {
+    qsort(writes, write_count, sizeof(RingEntry), write_compare);
+    int i = 0;
+    while (i < write_count) {
+        RingEntry *e = writes + i;
+        if (e->type != BLOCK) {
+            i++;
+            continue;
+        }
+        Blob blob;
+        blob_alloc(&blob, e->p, e->q);
+        read_blob(&blob);
+        for (; i < write_count; i++) {
+            e = writes + i;
+            if (e->type != BLOCK || e->p != blob.p || e->q != blob.q) {
+                break;
+            }
+            blob_set(&blob, e->x, e->y, e->z, e->w);
+        }
+        save_blob(&blob);
+        blob_free(&blob);
+    }
+}
+
+static void flush_writes() {
+    if (!write_count) {
+        return;
+    }
+    double start = glfwGetTime();
+    if (USE_CHUNK_BLOBS) {
+        save_blobs();
+    }
+    else {
+        insert_rows(insert_blocks_stmt, insert_block_stmt, BLOCK);
+    }
+    insert_rows(insert_lights_stmt, insert_light_stmt, LIGHT);
+    for (int i = 0; i < write_count; i++) {
+        RingEntry *e = writes + i;
+        if (e->type == KEY) {
+            _db_set_key(e->p, e->q, e->key);
+        }
+    }
+    double elapsed = glfwGetTime() - start;
+    mtx_lock(&mtx);
+    coalesced_count += write_coalesced;
+    written_count += write_count;
+    write_seconds += elapsed;
+    mtx_unlock(&mtx);
+    write_coalesced = 0;
+    write_count = 0;
+    memset(write_slots, 0, sizeof(write_slots));
+    uncommitted = 1;
+}
+
+static int tracked_chunk(int p, int q) {
+    sqlite3_reset(tracked_chunk_stmt);
+    sqlite3_bind_int(tracked_chunk_stmt, 1, p);
+    sqlite3_bind_int(tracked_chunk_stmt, 2, q);
+    int result = sqlite3_step(tracked_chunk_stmt) == SQLITE_ROW;
+    sqlite3_reset(tracked_chunk_stmt);
+    return result;
+}
+
+static void queue_write(RingEntry *e) {
+    int index = write_hash(e);
+    while (write_slots[index]) {
+        RingEntry *other = writes + write_slots[index] - 1;
+        if (write_equal(other, e)) {
+            other->w = e->w;
+            other->key = e->key;
+            write_coalesced++;
+            return;
+        }
+        index = (index + 1) & (DB_BATCH_SIZE * 2 - 1);
+    }
+    memcpy(writes + write_count, e, sizeof(RingEntry));
+    write_slots[index] = ++write_count;
+    if (write_count == DB_BATCH_SIZE) {
+        flush_writes();
+    }
+}
+
+static RingEntry *find_write(RingEntry *e) {
+    int index = write_hash(e);
+    while (write_slots[index]) {
+        RingEntry *other = writes + write_slots[index] - 1;
+        if (write_equal(other, e)) {
+            return other;
+        }
+        index = (index + 1) & (DB_BATCH_SIZE * 2 - 1);
+    }
+    return 0;
+}
+
+static void touch_chunk(int p, int q) {
+    sqlite3_reset(touch_chunk_stmt);
+    sqlite3_bind_int(touch_chunk_stmt, 1, p);
+    sqlite3_bind_int(touch_chunk_stmt, 2, q);
+    sqlite3_bind_int(touch_chunk_stmt, 3, time(NULL));
+    sqlite3_step(touch_chunk_stmt);
+    uncommitted = 1;
+}
+
+// drops the least recently used chunks until the cache is back under
+// 90% of its limit, the server resends them in full when asked with key 0
+static void evict_chunks() {
+    if (!cache_limit || cache_size() <= cache_limit) {
+        return;
+    }
+    double target = cache_limit * 0.9;
+    int evicted;
+    do {
+        int chunks[8][2];
+        evicted = 0;
+        sqlite3_reset(oldest_chunks_stmt);
+        while (sqlite3_step(oldest_chunks_stmt) == SQLITE_ROW) {
+            chunks[evicted][0] = sqlite3_column_int(oldest_chunks_stmt, 0);
+            chunks[evicted][1] = sqlite3_column_int(oldest_chunks_stmt, 1);
+            evicted++;
+        }
+        sqlite3_reset(oldest_chunks_stmt);
+        for (int i = 0; i < evicted; i++) {
+            for (int j = 0; j < 6; j++) {
+                sqlite3_stmt *stmt = evict_stmts[j];
+                sqlite3_reset(stmt);
+                sqlite3_bind_int(stmt, 1, chunks[i][0]);
+                sqlite3_bind_int(stmt, 2, chunks[i][1]);
+                sqlite3_step(stmt);
+            }
+        }
+    } while (evicted && cache_size() > target);
+    _db_commit();
+}
+
+// a key still waiting in the batch is newer than the one in the table
+static void get_key(RingEntry *e) {
+    if (cache_limit) {
+        touch_chunk(e->p, e->q);
+    }
+    RingEntry key = {KEY, e->p, e->q};
+    RingEntry *pending = find_write(&key);
+    e->key = 0;
+    if (pending) {
+        e->key = pending->key;
+    }
+    else {
+        sqlite3_reset(get_key_stmt);
+        sqlite3_bind_int(get_key_stmt, 1, e->p);
+        sqlite3_bind_int(get_key_stmt, 2, e->q);
+        if (sqlite3_step(get_key_stmt) == SQLITE_ROW) {
+            e->key = sqlite3_column_int(get_key_stmt, 0);
+        }
+    }
+    channel_put(&completions, e);
 }
 
 int db_worker_run(void *arg) {
     int running = 1;
     while (running) {
-        RingEntry e;
-        mtx_lock(&mtx);
-        while (!ring_get(&ring, &e)) {
-            cnd_wait(&cnd, &mtx);
+        channel_wait(&channel);
+        int count = 0;
+        while (count < DB_BATCH_SIZE && channel_get(&channel, batch + count)) {
+            count++;
         }
-        mtx_unlock(&mtx);
-        switch (e.type) {
-            case BLOCK:
-                _db_insert_block(e.p, e.q, e.x, e.y, e.z, e.w);
-                break;
-            case LIGHT:
-                _db_insert_light(e.p, e.q, e.x, e.y, e.z, e.w);
-                break;
-            case KEY:
-                _db_set_key(e.p, e.q, e.key);
-                break;
-            case COMMIT:
-                _db_commit();
-                break;
-            case EXIT:
-                running = 0;
-                break;
+        for (int i = 0; i < count && running; i++) {
+            RingEntry *e = batch + i;
+            switch (e->type) {
+                case BLOCK:
+                case LIGHT:
+                    // rows for an evicted chunk come back with its next
+                    // full resend
+                    if (!cache_limit || tracked_chunk(e->p, e->q)) {
+                        queue_write(e);
+                    }
+                    break;
+                case KEY:
+                    queue_write(e);
+                    break;
+                case TOUCH:
+                    if (cache_limit) {
+                        touch_chunk(e->p, e->q);
+                    }
+                    break;
+                case SIGN:
+                    _db_insert_sign(e);
+                    uncommitted = 1;
+                    break;
+                case DELETE_SIGN:
+                    _db_delete_sign(e->x, e->y, e->z, e->w);
+                    uncommitted = 1;
+                    break;
+                case DELETE_SIGNS:
+                    _db_delete_signs(e->x, e->y, e->z);
+                    uncommitted = 1;
+                    break;
+                case GET_KEY:
+                    get_key(e);
+                    break;
+                case COMMIT:
+                    flush_writes();
+                    _db_commit();
+                    evict_chunks();
+                    break;
+                case EXIT:
+                    flush_writes();
+                    running = 0;
+                    break;
+            }
+        }
+        // the readers only see committed writes, so every batch commits
+        flush_writes();
+        if (uncommitted && running) {
+            _db_commit();
         }
     }
     return 0;
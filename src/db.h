@@ -4,10 +4,13 @@
 #include "map.h"
 #include "sign.h"
 
+typedef void (*db_key_func)(int p, int q, int key);
+
+void db_cache_limit(int megabytes);
 void db_enable();
 void db_disable();
 int get_db_enabled();
-int db_init(char *path);
+int db_init(char *path, int reader_threads);
 void db_close();
 void db_commit();
 void db_auth_set(char *username, char *identity_token);
@@ -28,11 +31,16 @@ void db_insert_sign(
 void db_delete_sign(int x, int y, int z, int face);
 void db_delete_signs(int x, int y, int z);
 void db_delete_all_signs();
-void db_load_blocks(Map *map, int p, int q);
-void db_load_lights(Map *map, int p, int q);
-void db_load_signs(SignList *list, int p, int q);
-int db_get_key(int p, int q);
+int db_has_blocks(int p, int q, int reader);
+void db_load_blocks(Map *map, int p, int q, int reader);
+void db_load_lights(Map *map, int p, int q, int reader);
+void db_load_signs(SignList *list, int p, int q, int reader);
+void db_get_key(int p, int q, db_key_func callback);
+void db_touch_chunk(int p, int q);
+void db_complete();
+void db_assert_thread(int enabled);
 void db_set_key(int p, int q, int key);
+void db_write_stats(int *coalesced, double *rows_per_second);
 void db_worker_start();
 void db_worker_stop();
 int db_worker_run(void *arg);
@@ -0,0 +1,76 @@
+#include <GLFW/glfw3.h>
+#include <stdlib.h>
+#include "config.h"
+#include "governor.h"
+
+#define SAMPLES 512
+
+static double samples[SAMPLES];
+static int sample_count;
+static double window_start;
+static int over;
+static int under;
+static int cooldown;
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+void governor_reset() {
+    sample_count = 0;
+    window_start = glfwGetTime();
+    over = 0;
+    under = 0;
+    cooldown = 0;
+}
+
+void governor_frame(double frame_ms) {
+    if (sample_count < SAMPLES) {
+        samples[sample_count++] = frame_ms;
+    }
+}
+
+// decides once per GOVERNOR_INTERVAL; shrinking needs a couple of slow
+// windows in a row, growing needs several fast ones and no backlog, and
+// nothing changes for a while after a step so the effect can settle
+int governor_update(double target_ms, int backlog, double *p95) {
+    double now = glfwGetTime();
+    if (now - window_start < GOVERNOR_INTERVAL || sample_count < 8) {
+        return GOVERNOR_HOLD;
+    }
+    qsort(samples, sample_count, sizeof(double), cmp_double);
+    *p95 = samples[(sample_count * 95) / 100];
+    sample_count = 0;
+    window_start = now;
+    if (cooldown) {
+        cooldown--;
+        return GOVERNOR_HOLD;
+    }
+    if (*p95 > target_ms * GOVERNOR_SHRINK_RATIO) {
+        over++;
+        under = 0;
+    }
+    else if (*p95 < target_ms * GOVERNOR_GROW_RATIO &&
+        backlog <= GOVERNOR_MAX_BACKLOG)
+    {
+        under++;
+        over = 0;
+    }
+    else {
+        over = 0;
+        under = 0;
+    }
+    if (over >= GOVERNOR_SHRINK_WINDOWS) {
+        over = 0;
+        cooldown = GOVERNOR_COOLDOWN;
+        return GOVERNOR_SHRINK;
+    }
+    if (under >= GOVERNOR_GROW_WINDOWS) {
+        under = 0;
+        cooldown = GOVERNOR_COOLDOWN;
+        return GOVERNOR_GROW;
+    }
+    return GOVERNOR_HOLD;
+}
@@ -0,0 +1,12 @@
+#ifndef _governor_h_
+#define _governor_h_
+
+#define GOVERNOR_SHRINK -1
+#define GOVERNOR_HOLD 0
+#define GOVERNOR_GROW 1
+
+void governor_reset();
+void governor_frame(double frame_ms);
+int governor_update(double target_ms, int backlog, double *p95);
+
+#endif
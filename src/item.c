@@ -1,3 +1,4 @@
+#include "config.h"
 #include "item.h"
 #include "util.h"
 
@@ -86,6 +87,7 @@ int add_new_item(const char *name, int tile[7], bool is_plant, bool is_obstacle,
     new_item->is_obstacle = is_obstacle;
     new_item->is_transparent = is_transparent;
     new_item->is_destructable = is_destructable;
+    new_item->culls_same_faces = false;
 
     // add item to our internal list
     if (items == NULL) {
@@ -119,12 +121,12 @@ void setup_base_items() {
     add_new_item("dirt", (int[7]){6, 6, 6, 6, 6, 6, 0}, false, true, false, true);
     add_new_item("plank", (int[7]){7, 7, 7, 7, 7, 7, 0}, false, true, false, true);
     add_new_item("snow", (int[7]){40, 8, 24, 24, 24, 24, 0}, false, true, false, true);
-    add_new_item("glass", (int[7]){9, 9, 9, 9, 9, 9, 0}, false, true, true, true);
+    int glass = add_new_item("glass", (int[7]){9, 9, 9, 9, 9, 9, 0}, false, true, true, true);
     add_new_item("cobble", (int[7]){10, 10, 10, 10, 10, 10, 0}, false, true, false, true);
     add_new_item("light stone", (int[7]){11, 11, 11, 11, 11, 11, 0}, false, true, false, true);
     add_new_item("dark stone", (int[7]){12, 12, 12, 12, 12, 12, 0}, false, true, false, true);
     add_new_item("chest", (int[7]){13, 13, 13, 13, 13, 13, 0}, false, true, false, true);
-    add_new_item("leaves", (int[7]){14, 14, 14, 14, 14, 14, 0}, false, true, true, true);
+    int leaves = add_new_item("leaves", (int[7]){14, 14, 14, 14, 14, 14, 0}, false, true, true, true);
     add_new_item("cloud", (int[7]){15, 15, 15, 15, 15, 15, 0}, false, false, true, false);
     add_new_item("tall grass", (int[7]){0, 0, 0, 0, 0, 0, 48}, true, false, true, true);
     add_new_item("yellow flower", (int[7]){0, 0, 0, 0, 0, 0, 49}, true, false, true, true);
@@ -166,6 +168,10 @@ void setup_base_items() {
     add_new_item("color30", (int[7]){206, 206, 206, 206, 206, 206, 0}, false, true, false, true);
     add_new_item("color31", (int[7]){207, 207, 207, 207, 207, 207, 0}, false, true, false, true);
     add_new_item("error", (int[7]){30, 30, 30, 30, 30, 30, 0}, false, true, true, true);
+
+    // meshing policy for see-through blocks
+    set_culls_same_faces(glass, true);
+    set_culls_same_faces(leaves, FAST_LEAVES);
 }
 
 // is_* convenience functions
@@ -212,3 +218,22 @@ bool is_destructable(int item_id) {
 
     return false;
 }
+
+bool culls_same_faces(int item_id) {
+    item_id = ABS(item_id); // TODO: why are we getting negative item ids?
+    struct item_list *item = get_item_by_id(item_id);
+
+    if (item != NULL) {
+        return item->culls_same_faces;
+    }
+
+    return false;
+}
+
+void set_culls_same_faces(int item_id, bool culls) {
+    struct item_list *item = get_item_by_id(item_id);
+
+    if (item != NULL) {
+        item->culls_same_faces = culls;
+    }
+}
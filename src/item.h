@@ -27,6 +27,7 @@ struct item_list {
     bool is_obstacle;
     bool is_transparent;
     bool is_destructable;
+    bool culls_same_faces; // hide faces between two blocks of this type
 
     struct item_list *next_ptr;
 };
@@ -42,6 +43,8 @@ bool is_plant(int item_id);
 bool is_obstacle(int item_id);
 bool is_transparent(int item_id);
 bool is_destructable(int item_id);
+bool culls_same_faces(int item_id);
+void set_culls_same_faces(int item_id, bool culls);
 
 // global data
 struct item_list *items;
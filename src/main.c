@@ -8,14 +8,18 @@
 #include <time.h>
 #include "api.h"
 #include "auth.h"
+#include "benchmark.h"
+#include "blob.h"
 #include "client.h"
 #include "config.h"
 #include "cube.h"
 #include "db.h"
+#include "governor.h"
 #include "item.h"
 #include "map.h"
 #include "matrix.h"
 #include "noise.h"
+#include "profile.h"
 #include "sign.h"
 #include "tinycthread.h"
 #include "util.h"
@@ -23,12 +27,20 @@
 #include "clouds.h"
 
 #define MAX_CHUNKS 8192
+#define MAX_CACHED_CHUNKS 1024
+#define MAX_VIEW_RADIUS 24
+#define MAX_LOD_RADIUS 32
+// delete_lods keeps one ring past the farthest LOD
+#define MAX_LODS_SIDE (2 * (MAX_VIEW_RADIUS + MAX_LOD_RADIUS + 1) + 1)
+#define MAX_LODS (MAX_LODS_SIDE * MAX_LODS_SIDE)
+#define PLANT_TIERS 4
 #define MAX_PLAYERS 128
 #define WORKERS 4
 #define MAX_TEXT_LENGTH 256
 #define MAX_NAME_LENGTH 32
 #define MAX_PATH_LENGTH 256
 #define MAX_ADDR_LENGTH 256
+#define MAX_COMMANDS 16
 
 #define ALIGN_LEFT 0
 #define ALIGN_CENTER 1
@@ -41,6 +53,9 @@
 #define WORKER_BUSY 1
 #define WORKER_DONE 2
 
+#define UPLOAD_BLOCKS 1
+#define UPLOAD_SIGNS 2
+
 #define RECV_BUFFER_SIZE 1024
 #define TEXT_BUFFER_SIZE 256
 #define LEFT 0
@@ -57,22 +72,71 @@ typedef struct {
     int faces;
     int sign_faces;
     int dirty;
+    int sign_dirty;
+    int loaded;
+    int edge_edits;
+    unsigned char *cold_map; // maps of a chunk far from the player, see
+    unsigned char *cold_lights; // freeze_chunk
+    int cold_map_size;
+    int cold_lights_size;
     int miny;
     int maxy;
     GLuint buffer;
     GLuint sign_buffer;
+    GLuint cutout_buffer;
+    int cutout_faces;
+    GLuint plant_buffer;
+    int plant_tiers[PLANT_TIERS]; // faces in the first i + 1 tiers
+    int upload;
+    int upload_faces;
+    int upload_sign_faces;
+    int upload_cutout_faces;
+    int upload_plant_tiers[PLANT_TIERS];
+    GLfloat *upload_data;
+    GLfloat *upload_sign_data;
+    GLfloat *upload_cutout_data;
+    GLfloat *upload_plant_data;
+    double requested;
 } Chunk;
 
+typedef struct {
+    int p;
+    int q;
+    int faces;
+    int dirty;
+    int miny;
+    int maxy;
+    GLuint buffer;
+    int upload;
+    int upload_faces;
+    GLfloat *upload_data;
+} Lod;
+
+typedef struct {
+    Chunk chunk;
+    int bytes;
+    unsigned int used;
+} CachedChunk;
+
 typedef struct {
     int p; // chunk 'x' id
     int q; // chunk 'z' id
     int load;
+    int lod;
+    int edge_edits;
     Map *block_maps[3][3];
     Map *light_maps[3][3];
+    SignList *signs;
     int miny;
     int maxy;
     int faces;
+    int sign_faces;
+    int cutout_faces;
+    int plant_tiers[PLANT_TIERS];
     GLfloat *data;
+    GLfloat *sign_data;
+    GLfloat *cutout_data;
+    GLfloat *plant_data;
 } WorkerItem;
 
 typedef struct {
@@ -106,7 +170,13 @@ typedef struct {
     State state;
     State state1;
     State state2;
-    GLuint buffer;
+    State seen;
+    int seen_valid;
+    float vx;
+    float vz;
+    int prefetch;
+    int prefetch_p;
+    int prefetch_q;
 } Player;
 
 typedef struct {
@@ -122,19 +192,96 @@ typedef struct {
     GLuint extra2;
     GLuint extra3;
     GLuint extra4;
+    GLuint extra5;
+    GLuint extra6;
 } Attrib;
 
+typedef struct {
+    GLuint buffer;
+    int faces;
+} Mesh;
+
+typedef struct {
+    Chunk *chunk;
+    Lod *lod;
+    int score;
+} Upload;
+
+// everything the render thread needs to draw one view, copied out of the
+// model while the simulation thread is locked out; the matrices, planes
+// and crosshair hit are worked out once here and shared by every pass
+// and by the chunk scheduler
+typedef struct {
+    State state;
+    int width;
+    int height;
+    int ortho;
+    float fov;
+    float matrix[16];
+    float sky_matrix[16];
+    float planes[6][4];
+    int faces;
+    int mesh_count;
+    Mesh meshes[MAX_CHUNKS];
+    int cutout_count;
+    Mesh cutouts[MAX_CHUNKS * 2 + MAX_LODS];
+    int sign_count;
+    Mesh signs[MAX_CHUNKS];
+    int player_count;
+    GLfloat players[MAX_PLAYERS * 5];
+    int hit;
+    int hx;
+    int hy;
+    int hz;
+    int sign_hit;
+    int sx;
+    int sy;
+    int sz;
+    int sign_face;
+    char sign_text[MAX_SIGN_LENGTH];
+    char name[MAX_NAME_LENGTH];
+    char target[MAX_NAME_LENGTH];
+} Snapshot;
+
 typedef struct {
     GLFWwindow *window;
+    mtx_t mtx;
+    cnd_t cnd;
+    thrd_t sim_thrd;
+    int sim_running;
     Worker workers[WORKERS];
     Chunk chunks[MAX_CHUNKS];
     int chunk_count;
+    CachedChunk cached_chunks[MAX_CACHED_CHUNKS];
+    int cached_count;
+    int cached_bytes;
+    unsigned int cache_clock;
+    int cache_hits;
+    int cache_misses;
+    int cold_count;
+    int cold_bytes;
     int create_radius;
     int render_radius;
     int delete_radius;
     int sign_radius;
+    int plant_radius;
+    Lod lods[MAX_LODS];
+    int lod_count;
+    int lod_radius;
     Player players[MAX_PLAYERS];
     int player_count;
+    GLuint player_buffer;
+    GLuint player_instances;
+    GLuint *dead_buffers;
+    int dead_count;
+    int dead_capacity;
+    Snapshot views[2];
+    Upload uploads[MAX_CHUNKS + MAX_LODS];
+    double upload_budget_ms;
+    int upload_budget_bytes;
+    char commands[MAX_COMMANDS][MAX_TEXT_LENGTH];
+    int command_forward[MAX_COMMANDS];
+    int command_count;
     int typing;
     char typing_buffer[MAX_TEXT_LENGTH];
     int message_index;
@@ -156,6 +303,16 @@ typedef struct {
     int server_port;
     int day_length;
     int time_changed;
+    int show_profile;
+    int governor;
+    double governor_target;
+    int max_radius;
+    int max_lod_radius;
+    int max_plant_radius;
+    int cloud_limit;
+    int benchmark;
+    int benchmark_frame;
+    char benchmark_output[MAX_PATH_LENGTH];
     Block block0;
     Block block1;
     Block copy0;
@@ -317,6 +474,7 @@ void draw_triangles_3d_ao(Attrib *attrib, GLuint buffer, int count) {
     glVertexAttribPointer(attrib->uv, 4, GL_FLOAT, GL_FALSE,
         sizeof(GLfloat) * 10, (GLvoid *)(sizeof(GLfloat) * 6));
     glDrawArrays(GL_TRIANGLES, 0, count);
+    profile_draw(1);
     glDisableVertexAttribArray(attrib->position);
     glDisableVertexAttribArray(attrib->normal);
     glDisableVertexAttribArray(attrib->uv);
@@ -332,6 +490,7 @@ void draw_triangles_3d_text(Attrib *attrib, GLuint buffer, int count) {
     glVertexAttribPointer(attrib->uv, 2, GL_FLOAT, GL_FALSE,
         sizeof(GLfloat) * 5, (GLvoid *)(sizeof(GLfloat) * 3));
     glDrawArrays(GL_TRIANGLES, 0, count);
+    profile_draw(1);
     glDisableVertexAttribArray(attrib->position);
     glDisableVertexAttribArray(attrib->uv);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -349,6 +508,7 @@ void draw_triangles_3d(Attrib *attrib, GLuint buffer, int count) {
     glVertexAttribPointer(attrib->uv, 2, GL_FLOAT, GL_FALSE,
         sizeof(GLfloat) * 8, (GLvoid *)(sizeof(GLfloat) * 6));
     glDrawArrays(GL_TRIANGLES, 0, count);
+    profile_draw(1);
     glDisableVertexAttribArray(attrib->position);
     glDisableVertexAttribArray(attrib->normal);
     glDisableVertexAttribArray(attrib->uv);
@@ -364,6 +524,7 @@ void draw_triangles_2d(Attrib *attrib, GLuint buffer, int count) {
     glVertexAttribPointer(attrib->uv, 2, GL_FLOAT, GL_FALSE,
         sizeof(GLfloat) * 4, (GLvoid *)(sizeof(GLfloat) * 2));
     glDrawArrays(GL_TRIANGLES, 0, count);
+    profile_draw(1);
     glDisableVertexAttribArray(attrib->position);
     glDisableVertexAttribArray(attrib->uv);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -375,12 +536,13 @@ void draw_lines(Attrib *attrib, GLuint buffer, int components, int count) {
     glVertexAttribPointer(
         attrib->position, components, GL_FLOAT, GL_FALSE, 0, 0);
     glDrawArrays(GL_LINES, 0, count);
+    profile_draw(1);
     glDisableVertexAttribArray(attrib->position);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
-void draw_chunk(Attrib *attrib, Chunk *chunk) {
-    draw_triangles_3d_ao(attrib, chunk->buffer, chunk->faces * 6);
+void draw_mesh(Attrib *attrib, Mesh *mesh) {
+    draw_triangles_3d_ao(attrib, mesh->buffer, mesh->faces * 6);
 }
 
 void draw_item(Attrib *attrib, GLuint buffer, int count) {
@@ -394,10 +556,10 @@ void draw_text(Attrib *attrib, GLuint buffer, int length) {
     glDisable(GL_BLEND);
 }
 
-void draw_signs(Attrib *attrib, Chunk *chunk) {
+void draw_signs(Attrib *attrib, Mesh *mesh) {
     glEnable(GL_POLYGON_OFFSET_FILL);
     glPolygonOffset(-8, -1024);
-    draw_triangles_3d_text(attrib, chunk->sign_buffer, chunk->sign_faces * 6);
+    draw_triangles_3d_text(attrib, mesh->buffer, mesh->faces * 6);
     glDisable(GL_POLYGON_OFFSET_FILL);
 }
 
@@ -416,8 +578,54 @@ void draw_plant(Attrib *attrib, GLuint buffer) {
     draw_item(attrib, buffer, 24);
 }
 
-void draw_player(Attrib *attrib, Player *player) {
-    draw_cube(attrib, player->buffer);
+void draw_players(Attrib *attrib, GLfloat *data, int count) {
+    if (!count) {
+        return;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, g->player_buffer);
+    glEnableVertexAttribArray(attrib->position);
+    glEnableVertexAttribArray(attrib->normal);
+    glEnableVertexAttribArray(attrib->uv);
+    glVertexAttribPointer(attrib->position, 3, GL_FLOAT, GL_FALSE,
+        sizeof(GLfloat) * 10, 0);
+    glVertexAttribPointer(attrib->normal, 3, GL_FLOAT, GL_FALSE,
+        sizeof(GLfloat) * 10, (GLvoid *)(sizeof(GLfloat) * 3));
+    glVertexAttribPointer(attrib->uv, 4, GL_FLOAT, GL_FALSE,
+        sizeof(GLfloat) * 10, (GLvoid *)(sizeof(GLfloat) * 6));
+    if (GLEW_ARB_instanced_arrays) {
+        glBindBuffer(GL_ARRAY_BUFFER, g->player_instances);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 5 * count,
+            data, GL_STREAM_DRAW);
+        profile_upload(sizeof(GLfloat) * 5 * count);
+        glEnableVertexAttribArray(attrib->extra5);
+        glEnableVertexAttribArray(attrib->extra6);
+        glVertexAttribPointer(attrib->extra5, 3, GL_FLOAT, GL_FALSE,
+            sizeof(GLfloat) * 5, 0);
+        glVertexAttribPointer(attrib->extra6, 2, GL_FLOAT, GL_FALSE,
+            sizeof(GLfloat) * 5, (GLvoid *)(sizeof(GLfloat) * 3));
+        glVertexAttribDivisorARB(attrib->extra5, 1);
+        glVertexAttribDivisorARB(attrib->extra6, 1);
+        glDrawArraysInstancedARB(GL_TRIANGLES, 0, 36, count);
+        profile_draw(1);
+        glVertexAttribDivisorARB(attrib->extra5, 0);
+        glVertexAttribDivisorARB(attrib->extra6, 0);
+        glDisableVertexAttribArray(attrib->extra5);
+        glDisableVertexAttribArray(attrib->extra6);
+    }
+    else {
+        // no instancing: feed the transform as constant attributes
+        for (int i = 0; i < count; i++) {
+            GLfloat *d = data + i * 5;
+            glVertexAttrib3f(attrib->extra5, d[0], d[1], d[2]);
+            glVertexAttrib2f(attrib->extra6, d[3], d[4]);
+            glDrawArrays(GL_TRIANGLES, 0, 36);
+        }
+        profile_draw(count);
+    }
+    glDisableVertexAttribArray(attrib->position);
+    glDisableVertexAttribArray(attrib->normal);
+    glDisableVertexAttribArray(attrib->uv);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 Player *find_player(int id) {
@@ -449,8 +657,6 @@ void update_player(Player *player,
     else {
         State *s = &player->state;
         s->x = x; s->y = y; s->z = z; s->rx = rx; s->ry = ry;
-        del_buffer(player->buffer);
-        player->buffer = gen_player_buffer(s->x, s->y, s->z, s->rx, s->ry);
     }
 }
 
@@ -478,17 +684,12 @@ void delete_player(int id) {
         return;
     }
     int count = g->player_count;
-    del_buffer(player->buffer);
     Player *other = g->players + (--count);
     memcpy(player, other, sizeof(Player));
     g->player_count = count;
 }
 
 void delete_all_players() {
-    for (int i = 0; i < g->player_count; i++) {
-        Player *player = g->players + i;
-        del_buffer(player->buffer);
-    }
     g->player_count = 0;
 }
 
@@ -547,6 +748,154 @@ Chunk *find_chunk(int p, int q) {
     return 0;
 }
 
+Lod *find_lod(int p, int q) {
+    for (int i = 0; i < g->lod_count; i++) {
+        Lod *lod = g->lods + i;
+        if (lod->p == p && lod->q == q) {
+            return lod;
+        }
+    }
+    return 0;
+}
+
+int get_view_radius() {
+    return g->render_radius + g->lod_radius;
+}
+
+void del_buffer_later(GLuint buffer) {
+    if (!buffer) {
+        return;
+    }
+    if (g->dead_count == g->dead_capacity) {
+        g->dead_capacity = g->dead_capacity ? g->dead_capacity * 2 : 64;
+        g->dead_buffers = (GLuint *)realloc(
+            g->dead_buffers, sizeof(GLuint) * g->dead_capacity);
+    }
+    g->dead_buffers[g->dead_count++] = buffer;
+}
+
+void del_dead_buffers() {
+    if (g->dead_count) {
+        glDeleteBuffers(g->dead_count, g->dead_buffers);
+        g->dead_count = 0;
+    }
+}
+
+// chunks outside the render radius are only read again when the player
+// comes back, so their maps are kept in the chunk blob encoding until then
+void freeze_chunk(Chunk *chunk) {
+    if (chunk->cold_map) {
+        return;
+    }
+    chunk->cold_map_size = blob_encode_map(
+        &chunk->map, chunk->p, chunk->q, &chunk->cold_map);
+    chunk->cold_lights = 0;
+    chunk->cold_lights_size = 0;
+    if (chunk->lights.size) {
+        chunk->cold_lights_size = blob_encode_map(
+            &chunk->lights, chunk->p, chunk->q, &chunk->cold_lights);
+    }
+    map_free(&chunk->map);
+    map_free(&chunk->lights);
+    g->cold_count++;
+    g->cold_bytes += chunk->cold_map_size + chunk->cold_lights_size;
+}
+
+void thaw_chunk(Chunk *chunk) {
+    if (!chunk->cold_map) {
+        return;
+    }
+    int dx = chunk->p * CHUNK_SIZE - 1;
+    int dz = chunk->q * CHUNK_SIZE - 1;
+    map_alloc(&chunk->map, dx, 0, dz, 0x7fff);
+    blob_load_map(
+        &chunk->map, chunk->p, chunk->q,
+        chunk->cold_map, chunk->cold_map_size);
+    map_alloc(&chunk->lights, dx, 0, dz, 0xf);
+    if (chunk->cold_lights) {
+        blob_load_map(
+            &chunk->lights, chunk->p, chunk->q,
+            chunk->cold_lights, chunk->cold_lights_size);
+    }
+    g->cold_count--;
+    g->cold_bytes -= chunk->cold_map_size + chunk->cold_lights_size;
+    free(chunk->cold_map);
+    free(chunk->cold_lights);
+    chunk->cold_map = 0;
+    chunk->cold_lights = 0;
+}
+
+void free_chunk(Chunk *chunk) {
+    if (chunk->cold_map) {
+        g->cold_count--;
+        g->cold_bytes -= chunk->cold_map_size + chunk->cold_lights_size;
+        free(chunk->cold_map);
+        free(chunk->cold_lights);
+    }
+    else {
+        map_free(&chunk->map);
+        map_free(&chunk->lights);
+    }
+    sign_list_free(&chunk->signs);
+    free(chunk->upload_data);
+    free(chunk->upload_sign_data);
+    free(chunk->upload_cutout_data);
+    free(chunk->upload_plant_data);
+    del_buffer_later(chunk->buffer);
+    del_buffer_later(chunk->sign_buffer);
+    del_buffer_later(chunk->cutout_buffer);
+    del_buffer_later(chunk->plant_buffer);
+}
+
+CachedChunk *find_cached_chunk(int p, int q) {
+    for (int i = 0; i < g->cached_count; i++) {
+        CachedChunk *entry = g->cached_chunks + i;
+        if (entry->chunk.p == p && entry->chunk.q == q) {
+            return entry;
+        }
+    }
+    return 0;
+}
+
+void remove_cached_chunk(CachedChunk *entry) {
+    g->cached_bytes -= entry->bytes;
+    CachedChunk *other = g->cached_chunks + (--g->cached_count);
+    memcpy(entry, other, sizeof(CachedChunk));
+}
+
+void free_cached_chunk(CachedChunk *entry) {
+    free_chunk(&entry->chunk);
+    remove_cached_chunk(entry);
+}
+
+// an edit to an evicted chunk makes its cached copy useless
+void drop_cached_chunk(int p, int q) {
+    CachedChunk *entry = find_cached_chunk(p, q);
+    if (entry) {
+        free_cached_chunk(entry);
+    }
+}
+
+// a neighbour changed, the blocks are still good but the mesh is not
+void stale_cached_chunk(int p, int q) {
+    CachedChunk *entry = find_cached_chunk(p, q);
+    if (entry) {
+        entry->chunk.dirty = 1;
+    }
+}
+
+void delete_cached_chunks() {
+    while (g->cached_count) {
+        free_cached_chunk(g->cached_chunks);
+    }
+}
+
+void yield_model() {
+    mtx_unlock(&g->mtx);
+    thrd_yield();
+    mtx_lock(&g->mtx);
+}
+
 int chunk_distance(Chunk *chunk, int p, int q) {
     int dp = ABS(chunk->p - p);
     int dq = ABS(chunk->q - q);
@@ -602,6 +951,7 @@ int highest_block(float x, float z) {
     int q = chunked(z);
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
+        thaw_chunk(chunk);
         Map *map = &chunk->map;
         MAP_FOR_EACH(map, ex, ey, ez, ew) {
             if (is_obstacle(ew) && ex == nx && ez == nz) {
@@ -659,6 +1009,7 @@ int hit_test(
         if (chunk_distance(chunk, p, q) > 1) {
             continue;
         }
+        thaw_chunk(chunk);
         int hx, hy, hz;
         int hw = _hit_test(&chunk->map, 8, previous,
             x, y, z, vx, vy, vz, &hx, &hy, &hz);
@@ -675,15 +1026,13 @@ int hit_test(
     return result;
 }
 
-int hit_test_face(Player *player, int *x, int *y, int *z, int *face) {
-    State *s = &player->state;
-    int w = hit_test(0, s->x, s->y, s->z, s->rx, s->ry, x, y, z);
+int _hit_test_face(State *s, int w, int x, int y, int z, int *face) {
     if (is_obstacle(w)) {
         int hx, hy, hz;
         hit_test(1, s->x, s->y, s->z, s->rx, s->ry, &hx, &hy, &hz);
-        int dx = hx - *x;
-        int dy = hy - *y;
-        int dz = hz - *z;
+        int dx = hx - x;
+        int dy = hy - y;
+        int dz = hz - z;
         if (dx == -1 && dy == 0 && dz == 0) {
             *face = 0; return 1;
         }
@@ -708,6 +1057,12 @@ int hit_test_face(Player *player, int *x, int *y, int *z, int *face) {
     return 0;
 }
 
+int hit_test_face(Player *player, int *x, int *y, int *z, int *face) {
+    State *s = &player->state;
+    int w = hit_test(0, s->x, s->y, s->z, s->rx, s->ry, x, y, z);
+    return _hit_test_face(s, w, *x, *y, *z, face);
+}
+
 int collide(int height, float *x, float *y, float *z) {
     int result = 0;
     int p = chunked(*x);
@@ -716,6 +1071,7 @@ int collide(int height, float *x, float *y, float *z) {
     if (!chunk) {
         return result;
     }
+    thaw_chunk(chunk);
     Map *map = &chunk->map;
     int nx = roundf(*x);
     int ny = roundf(*y);
@@ -828,8 +1184,8 @@ int _gen_sign_buffer(
     return count;
 }
 
-void gen_sign_buffer(Chunk *chunk) {
-    SignList *signs = &chunk->signs;
+void compute_signs(WorkerItem *item) {
+    SignList *signs = item->signs;
 
     // first pass - count characters
     int max_faces = 0;
@@ -847,9 +1203,8 @@ void gen_sign_buffer(Chunk *chunk) {
             data + faces * 30, e->x, e->y, e->z, e->face, e->text);
     }
 
-    del_buffer(chunk->sign_buffer);
-    chunk->sign_buffer = gen_faces(5, faces, data);
-    chunk->sign_faces = faces;
+    item->sign_faces = faces;
+    item->sign_data = data;
 }
 
 int has_lights(Chunk *chunk) {
@@ -874,6 +1229,23 @@ int has_lights(Chunk *chunk) {
     return 0;
 }
 
+void dirty_neighbors(int p, int q) {
+    for (int dp = -1; dp <= 1; dp++) {
+        for (int dq = -1; dq <= 1; dq++) {
+            if (!dp && !dq) {
+                continue;
+            }
+            Chunk *other = find_chunk(p + dp, q + dq);
+            if (other) {
+                other->dirty = 1;
+            }
+            else {
+                stale_cached_chunk(p + dp, q + dq);
+            }
+        }
+    }
+}
+
 void dirty_chunk(Chunk *chunk) {
     chunk->dirty = 1;
     if (has_lights(chunk)) {
@@ -883,6 +1255,9 @@ void dirty_chunk(Chunk *chunk) {
                 if (other) {
                     other->dirty = 1;
                 }
+                else {
+                    stale_cached_chunk(chunk->p + dp, chunk->q + dq);
+                }
             }
         }
     }
@@ -967,6 +1342,28 @@ void light_fill(
     light_fill(opaque, light, x, y, z + 1, w, 0);
 }
 
+int plant_tier(int x, int z) {
+    unsigned int h = (unsigned int)x * 73856093u ^ (unsigned int)z * 19349663u;
+    return (h >> 4) % PLANT_TIERS;
+}
+
+// each block is read from the map of the chunk that owns it, a chunk's
+// own border cells are only used while that neighbour is not loaded
+Map *block_owner(WorkerItem *item, int x, int z) {
+    int a = x - item->p * CHUNK_SIZE + CHUNK_SIZE;
+    int b = z - item->q * CHUNK_SIZE + CHUNK_SIZE;
+    if (a < 0 || b < 0 || a >= CHUNK_SIZE * 3 || b >= CHUNK_SIZE * 3) {
+        return 0;
+    }
+    Map *map = item->block_maps[a / CHUNK_SIZE][b / CHUNK_SIZE];
+    return map ? map : item->block_maps[1][1];
+}
+
+int owned_block(WorkerItem *item, int x, int y, int z) {
+    Map *map = block_owner(item, x, z);
+    return map ? map_get(map, x, y, z) : 0;
+}
+
 void compute_chunk(WorkerItem *item) {
     char *opaque = (char *)calloc(XZ_SIZE * XZ_SIZE * Y_SIZE, sizeof(char));
     char *light = (char *)calloc(XZ_SIZE * XZ_SIZE * Y_SIZE, sizeof(char));
@@ -997,18 +1394,16 @@ void compute_chunk(WorkerItem *item) {
                 continue;
             }
             MAP_FOR_EACH(map, ex, ey, ez, ew) {
+                if (block_owner(item, ex, ez) != map) {
+                    continue;
+                }
                 int x = ex - ox;
                 int y = ey - oy;
                 int z = ez - oz;
                 int w = ew;
-                // TODO: this should be unnecessary
-                if (x < 0 || y < 0 || z < 0) {
-                    continue;
-                }
-                if (x >= XZ_SIZE || y >= Y_SIZE || z >= XZ_SIZE) {
+                if (y < 0 || y >= Y_SIZE) {
                     continue;
                 }
-                // END TODO
                 opaque[XYZ(x, y, z)] = !is_transparent(w);
                 if (opaque[XYZ(x, y, z)]) {
                     highest[XZ(x, z)] = MAX(highest[XZ(x, z)], y);
@@ -1037,10 +1432,12 @@ void compute_chunk(WorkerItem *item) {
 
     Map *map = item->block_maps[1][1];
 
-    // count exposed faces
+    // count exposed faces, plants separately by thinning tier
     int miny = 256;
     int maxy = 0;
     int faces = 0;
+    int cutout_faces = 0;
+    int plant_offsets[PLANT_TIERS] = {0};
     MAP_FOR_EACH(map, ex, ey, ez, ew) {
         if (ew <= 0) {
             continue;
@@ -1054,21 +1451,44 @@ void compute_chunk(WorkerItem *item) {
         int f4 = !opaque[XYZ(x, y - 1, z)] && (ey > 0);
         int f5 = !opaque[XYZ(x, y, z - 1)];
         int f6 = !opaque[XYZ(x, y, z + 1)];
+        if (culls_same_faces(ew)) {
+            f1 = f1 && ABS(owned_block(item, ex - 1, ey, ez)) != ew;
+            f2 = f2 && ABS(owned_block(item, ex + 1, ey, ez)) != ew;
+            f3 = f3 && ABS(map_get(map, ex, ey + 1, ez)) != ew;
+            f4 = f4 && ABS(map_get(map, ex, ey - 1, ez)) != ew;
+            f5 = f5 && ABS(owned_block(item, ex, ey, ez - 1)) != ew;
+            f6 = f6 && ABS(owned_block(item, ex, ey, ez + 1)) != ew;
+        }
         int total = f1 + f2 + f3 + f4 + f5 + f6;
         if (total == 0) {
             continue;
         }
-        if (is_plant(ew)) {
-            total = 4;
-        }
         miny = MIN(miny, ey);
         maxy = MAX(maxy, ey);
-        faces += total;
+        if (is_plant(ew)) {
+            plant_offsets[plant_tier(ex, ez)] += 4;
+        }
+        else if (is_transparent(ew)) {
+            cutout_faces += total;
+        }
+        else {
+            faces += total;
+        }
     } END_MAP_FOR_EACH;
+    int plant_faces = 0;
+    for (int i = 0; i < PLANT_TIERS; i++) {
+        int count = plant_offsets[i];
+        plant_offsets[i] = plant_faces * 60;
+        plant_faces += count;
+        item->plant_tiers[i] = plant_faces;
+    }
 
     // generate geometry
     GLfloat *data = malloc_faces(10, faces);
+    GLfloat *cutout_data = malloc_faces(10, cutout_faces);
+    GLfloat *plant_data = malloc_faces(10, plant_faces);
     int offset = 0;
+    int cutout_offset = 0;
     MAP_FOR_EACH(map, ex, ey, ez, ew) {
         if (ew <= 0) {
             continue;
@@ -1082,6 +1502,14 @@ void compute_chunk(WorkerItem *item) {
         int f4 = !opaque[XYZ(x, y - 1, z)] && (ey > 0);
         int f5 = !opaque[XYZ(x, y, z - 1)];
         int f6 = !opaque[XYZ(x, y, z + 1)];
+        if (culls_same_faces(ew)) {
+            f1 = f1 && ABS(owned_block(item, ex - 1, ey, ez)) != ew;
+            f2 = f2 && ABS(owned_block(item, ex + 1, ey, ez)) != ew;
+            f3 = f3 && ABS(map_get(map, ex, ey + 1, ez)) != ew;
+            f4 = f4 && ABS(map_get(map, ex, ey - 1, ez)) != ew;
+            f5 = f5 && ABS(owned_block(item, ex, ey, ez - 1)) != ew;
+            f6 = f6 && ABS(owned_block(item, ex, ey, ez + 1)) != ew;
+        }
         int total = f1 + f2 + f3 + f4 + f5 + f6;
         if (total == 0) {
             continue;
@@ -1112,7 +1540,6 @@ void compute_chunk(WorkerItem *item) {
         float light[6][4];
         occlusion(neighbors, lights, shades, ao, light);
         if (is_plant(ew)) {
-            total = 4;
             float min_ao = 1;
             float max_light = 0;
             for (int a = 0; a < 6; a++) {
@@ -1122,17 +1549,26 @@ void compute_chunk(WorkerItem *item) {
                 }
             }
             float rotation = simplex2(ex, ez, 4, 0.5, 2) * 360;
+            int *plant_offset = plant_offsets + plant_tier(ex, ez);
             make_plant(
-                data + offset, min_ao, max_light,
+                plant_data + *plant_offset, min_ao, max_light,
                 ex, ey, ez, 0.5, ew, rotation);
+            *plant_offset += 4 * 60;
+        }
+        else if (is_transparent(ew)) {
+            make_cube(
+                cutout_data + cutout_offset, ao, light,
+                f1, f2, f3, f4, f5, f6,
+                ex, ey, ez, 0.5, ew);
+            cutout_offset += total * 60;
         }
         else {
             make_cube(
                 data + offset, ao, light,
                 f1, f2, f3, f4, f5, f6,
                 ex, ey, ez, 0.5, ew);
+            offset += total * 60;
         }
-        offset += total * 60;
     } END_MAP_FOR_EACH;
 
     free(opaque);
@@ -1143,15 +1579,228 @@ void compute_chunk(WorkerItem *item) {
     item->maxy = maxy;
     item->faces = faces;
     item->data = data;
+    item->cutout_faces = cutout_faces;
+    item->cutout_data = cutout_data;
+    item->plant_data = plant_data;
 }
 
 void generate_chunk(Chunk *chunk, WorkerItem *item) {
-    chunk->miny = item->miny;
-    chunk->maxy = item->maxy;
-    chunk->faces = item->faces;
-    del_buffer(chunk->buffer);
-    chunk->buffer = gen_faces(10, item->faces, item->data);
-    gen_sign_buffer(chunk);
+    if (item->block_maps[1][1]) {
+        chunk->miny = item->miny;
+        chunk->maxy = item->maxy;
+        free(chunk->upload_data);
+        chunk->upload_faces = item->faces;
+        chunk->upload_data = item->data;
+        free(chunk->upload_cutout_data);
+        chunk->upload_cutout_faces = item->cutout_faces;
+        chunk->upload_cutout_data = item->cutout_data;
+        free(chunk->upload_plant_data);
+        memcpy(chunk->upload_plant_tiers, item->plant_tiers,
+            sizeof(item->plant_tiers));
+        chunk->upload_plant_data = item->plant_data;
+        chunk->upload |= UPLOAD_BLOCKS;
+    }
+    if (item->signs) {
+        free(chunk->upload_sign_data);
+        chunk->upload_sign_faces = item->sign_faces;
+        chunk->upload_sign_data = item->sign_data;
+        chunk->upload |= UPLOAD_SIGNS;
+    }
+}
+
+void upload_chunk(Chunk *chunk) {
+    if (chunk->upload & UPLOAD_BLOCKS) {
+        del_buffer(chunk->buffer);
+        chunk->buffer = gen_faces(10, chunk->upload_faces, chunk->upload_data);
+        chunk->faces = chunk->upload_faces;
+        chunk->upload_data = 0;
+        del_buffer(chunk->cutout_buffer);
+        chunk->cutout_buffer = gen_faces(
+            10, chunk->upload_cutout_faces, chunk->upload_cutout_data);
+        chunk->cutout_faces = chunk->upload_cutout_faces;
+        chunk->upload_cutout_data = 0;
+        del_buffer(chunk->plant_buffer);
+        chunk->plant_buffer = gen_faces(
+            10, chunk->upload_plant_tiers[PLANT_TIERS - 1],
+            chunk->upload_plant_data);
+        memcpy(chunk->plant_tiers, chunk->upload_plant_tiers,
+            sizeof(chunk->plant_tiers));
+        chunk->upload_plant_data = 0;
+        if (chunk->requested) {
+            benchmark_chunk((glfwGetTime() - chunk->requested) * 1000);
+            chunk->requested = 0;
+        }
+    }
+    if (chunk->upload & UPLOAD_SIGNS) {
+        del_buffer(chunk->sign_buffer);
+        chunk->sign_buffer = gen_faces(
+            5, chunk->upload_sign_faces, chunk->upload_sign_data);
+        chunk->sign_faces = chunk->upload_sign_faces;
+        chunk->upload_sign_data = 0;
+    }
+    chunk->upload = 0;
+}
+
+void upload_lod(Lod *lod) {
+    del_buffer(lod->buffer);
+    lod->buffer = gen_faces(10, lod->upload_faces, lod->upload_data);
+    lod->faces = lod->upload_faces;
+    lod->upload_data = 0;
+    lod->upload = 0;
+}
+
+int upload_size(Upload *upload) {
+    if (upload->lod) {
+        return upload->lod->upload_faces * 60 * sizeof(GLfloat);
+    }
+    Chunk *chunk = upload->chunk;
+    int size = 0;
+    if (chunk->upload & UPLOAD_BLOCKS) {
+        size += chunk->upload_faces * 60 * sizeof(GLfloat);
+        size += chunk->upload_cutout_faces * 60 * sizeof(GLfloat);
+        size += chunk->upload_plant_tiers[PLANT_TIERS - 1] * 60 *
+            sizeof(GLfloat);
+    }
+    if (chunk->upload & UPLOAD_SIGNS) {
+        size += chunk->upload_sign_faces * 30 * sizeof(GLfloat);
+    }
+    return size;
+}
+
+int upload_compare(const void *a, const void *b) {
+    return ((const Upload *)a)->score - ((const Upload *)b)->score;
+}
+
+// prioritised against the previous frame's view, which is close enough
+int upload_chunks() {
+    Snapshot *view = g->views;
+    State *s = &view->state;
+    int p = chunked(s->x);
+    int q = chunked(s->z);
+    int count = 0;
+    for (int i = 0; i < g->chunk_count; i++) {
+        Chunk *chunk = g->chunks + i;
+        if (!chunk->upload) {
+            continue;
+        }
+        int invisible = !chunk_visible(
+            view->planes, chunk->p, chunk->q, chunk->miny, chunk->maxy);
+        Upload *upload = g->uploads + count++;
+        upload->chunk = chunk;
+        upload->lod = 0;
+        upload->score = invisible * 1024 + chunk_distance(chunk, p, q);
+    }
+    for (int i = 0; i < g->lod_count; i++) {
+        Lod *lod = g->lods + i;
+        if (!lod->upload) {
+            continue;
+        }
+        int invisible = !chunk_visible(
+            view->planes, lod->p, lod->q, lod->miny, lod->maxy);
+        Upload *upload = g->uploads + count++;
+        upload->chunk = 0;
+        upload->lod = lod;
+        upload->score =
+            invisible * 1024 + MAX(ABS(lod->p - p), ABS(lod->q - q));
+    }
+    qsort(g->uploads, count, sizeof(Upload), upload_compare);
+    // always upload at least one mesh so a huge one can't stall the queue
+    double start = glfwGetTime();
+    double elapsed = 0;
+    int bytes = 0;
+    int done = 0;
+    while (done < count) {
+        Upload *upload = g->uploads + done;
+        int size = upload_size(upload);
+        if (done && bytes + size > g->upload_budget_bytes) {
+            break;
+        }
+        if (upload->lod) {
+            upload_lod(upload->lod);
+        }
+        else {
+            upload_chunk(upload->chunk);
+        }
+        bytes += size;
+        done++;
+        elapsed = (glfwGetTime() - start) * 1000;
+        if (elapsed >= g->upload_budget_ms) {
+            break;
+        }
+    }
+    profile_backlog(count - done, elapsed > g->upload_budget_ms);
+    return count - done;
+}
+
+void set_view_radius(int radius) {
+    g->create_radius = radius;
+    g->render_radius = radius;
+    g->delete_radius = radius + 4;
+}
+
+// clouds go first and come back last, the view radius goes last and comes
+// back first; each step is logged so the defaults can be tuned
+void update_governor(double frame_ms, int backlog) {
+    // clouds belong to the render thread, so limits set elsewhere are
+    // applied here
+    if (SHOW_CLOUDS && weather->cloud_limit != g->cloud_limit) {
+        set_cloud_limit(g->cloud_limit);
+    }
+    if (!g->governor) {
+        return;
+    }
+    governor_frame(frame_ms);
+    double p95;
+    int step = governor_update(g->governor_target, backlog, &p95);
+    int cloud_step = MAXIMUM_CLOUDS / 4;
+    if (step == GOVERNOR_SHRINK) {
+        if (g->cloud_limit > 0) {
+            g->cloud_limit = MAX(0, g->cloud_limit - cloud_step);
+        }
+        else if (g->plant_radius > 0) {
+            g->plant_radius = MAX(0, g->plant_radius - 2);
+        }
+        else if (g->lod_radius > 0) {
+            g->lod_radius = MAX(0, g->lod_radius - 2);
+        }
+        else if (g->render_radius > GOVERNOR_MIN_RADIUS) {
+            set_view_radius(g->render_radius - 1);
+        }
+        else {
+            return;
+        }
+    }
+    else if (step == GOVERNOR_GROW) {
+        if (g->render_radius < g->max_radius) {
+            set_view_radius(g->render_radius + 1);
+        }
+        else if (g->lod_radius < g->max_lod_radius) {
+            g->lod_radius = MIN(g->max_lod_radius, g->lod_radius + 2);
+        }
+        else if (g->plant_radius < g->max_plant_radius) {
+            g->plant_radius = MIN(g->max_plant_radius, g->plant_radius + 2);
+        }
+        else if (g->cloud_limit < MAXIMUM_CLOUDS) {
+            g->cloud_limit = MIN(MAXIMUM_CLOUDS, g->cloud_limit + cloud_step);
+        }
+        else {
+            return;
+        }
+    }
+    else {
+        return;
+    }
+    printf("[Governor] %s at p95 %.1fms, backlog %d: "
+        "radius %d, lod %d, plants %d, clouds %d\n",
+        step == GOVERNOR_SHRINK ? "shrink" : "grow", p95, backlog,
+        g->render_radius, g->lod_radius, g->plant_radius, g->cloud_limit);
+}
+
+void restore_detail() {
+    set_view_radius(g->max_radius);
+    g->lod_radius = g->max_lod_radius;
+    g->plant_radius = g->max_plant_radius;
+    g->cloud_limit = MAXIMUM_CLOUDS;
 }
 
 void gen_chunk_buffer(Chunk *chunk) {
@@ -1159,13 +1808,15 @@ void gen_chunk_buffer(Chunk *chunk) {
     WorkerItem *item = &_item;
     item->p = chunk->p;
     item->q = chunk->q;
+    item->signs = chunk->sign_dirty ? &chunk->signs : 0;
     for (int dp = -1; dp <= 1; dp++) {
         for (int dq = -1; dq <= 1; dq++) {
             Chunk *other = chunk;
             if (dp || dq) {
                 other = find_chunk(chunk->p + dp, chunk->q + dq);
             }
-            if (other) {
+            if (other && chunk->dirty && (other == chunk || other->loaded)) {
+                thaw_chunk(other);
                 item->block_maps[dp + 1][dq + 1] = &other->map;
                 item->light_maps[dp + 1][dq + 1] = &other->lights;
             }
@@ -1175,9 +1826,15 @@ void gen_chunk_buffer(Chunk *chunk) {
             }
         }
     }
-    compute_chunk(item);
+    if (item->block_maps[1][1]) {
+        compute_chunk(item);
+    }
+    if (item->signs) {
+        compute_signs(item);
+    }
     generate_chunk(chunk, item);
     chunk->dirty = 0;
+    chunk->sign_dirty = 0;
 }
 
 void map_set_func(int x, int y, int z, int w, void *arg) {
@@ -1185,21 +1842,281 @@ void map_set_func(int x, int y, int z, int w, void *arg) {
     map_set(map, x, y, z, w);
 }
 
-void load_chunk(WorkerItem *item) {
+// reader 0 belongs to the simulation thread, worker i uses reader i + 1
+void load_chunk(WorkerItem *item, int reader) {
     int p = item->p;
     int q = item->q;
     Map *block_map = item->block_maps[1][1];
     Map *light_map = item->light_maps[1][1];
     create_world(p, q, map_set_func, block_map);
-    db_load_blocks(block_map, p, q);
-    db_load_lights(light_map, p, q);
+    // neighbours meshed this chunk's edges from their own generated border,
+    // they only need rebuilding if an edit landed on one of those edges
+    Map generated;
+    map_copy(&generated, block_map);
+    db_load_blocks(block_map, p, q, reader);
+    item->edge_edits = 0;
+    Map *map = block_map;
+    MAP_FOR_EACH(map, ex, ey, ez, ew) {
+        int x = ex - p * CHUNK_SIZE;
+        int z = ez - q * CHUNK_SIZE;
+        if (x != 0 && z != 0 && x != CHUNK_SIZE - 1 && z != CHUNK_SIZE - 1) {
+            continue;
+        }
+        if (x < 0 || z < 0 || x >= CHUNK_SIZE || z >= CHUNK_SIZE) {
+            continue;
+        }
+        if (map_get(&generated, ex, ey, ez) != ew) {
+            item->edge_edits = 1;
+            break;
+        }
+    } END_MAP_FOR_EACH;
+    map_free(&generated);
+    db_load_lights(light_map, p, q, reader);
+    db_load_signs(item->signs, p, q, reader);
 }
 
-void request_chunk(int p, int q) {
-    int key = db_get_key(p, q);
+#define LOD_SIZE (CHUNK_SIZE / LOD_STEP)
+
+int lod_height(int heights[LOD_SIZE][LOD_SIZE], int a, int b, int floor) {
+    if (a < 0 || b < 0 || a >= LOD_SIZE || b >= LOD_SIZE) {
+        return floor;
+    }
+    return heights[a][b];
+}
+
+typedef struct {
+    int ox;
+    int oz;
+    int (*heights)[LOD_SIZE];
+    int (*blocks)[LOD_SIZE];
+} LodColumns;
+
+void lod_column(LodColumns *columns, int ex, int ey, int ez, int ew) {
+    int x = ex - columns->ox;
+    int z = ez - columns->oz;
+    if (ew <= 0 || !is_obstacle(ew)) {
+        return;
+    }
+    if (x < 0 || z < 0 || x >= CHUNK_SIZE || z >= CHUNK_SIZE) {
+        return;
+    }
+    int a = x / LOD_STEP;
+    int b = z / LOD_STEP;
+    if (ey > columns->heights[a][b]) {
+        columns->heights[a][b] = ey;
+        columns->blocks[a][b] = ew;
+    }
+}
+
+void lod_column_func(int x, int y, int z, int w, void *arg) {
+    lod_column((LodColumns *)arg, x, y, z, w);
+}
+
+void compute_lod(WorkerItem *item, int reader) {
+    int ox = item->p * CHUNK_SIZE;
+    int oz = item->q * CHUNK_SIZE;
+
+    // tallest obstacle in each LOD_STEP x LOD_STEP column
+    int heights[LOD_SIZE][LOD_SIZE];
+    int blocks[LOD_SIZE][LOD_SIZE];
+    for (int a = 0; a < LOD_SIZE; a++) {
+        for (int b = 0; b < LOD_SIZE; b++) {
+            heights[a][b] = -1;
+            blocks[a][b] = 0;
+        }
+    }
+    LodColumns columns = {ox, oz, heights, blocks};
+    if (db_has_blocks(item->p, item->q, reader)) {
+        // edits can remove blocks, so they need the whole chunk
+        Map _map;
+        Map *map = &_map;
+        map_alloc(map, ox - 1, 0, oz - 1, 0x7fff);
+        create_world(item->p, item->q, map_set_func, map);
+        db_load_blocks(map, item->p, item->q, reader);
+        MAP_FOR_EACH(map, ex, ey, ez, ew) {
+            lod_column(&columns, ex, ey, ez, ew);
+        } END_MAP_FOR_EACH;
+        map_free(map);
+    }
+    else {
+        create_world(item->p, item->q, lod_column_func, &columns);
+    }
+
+    // sides facing outside the chunk hang down to a skirt
+    int miny = 256;
+    int maxy = 0;
+    int faces = 0;
+    for (int a = 0; a < LOD_SIZE; a++) {
+        for (int b = 0; b < LOD_SIZE; b++) {
+            if (heights[a][b] >= 0) {
+                miny = MIN(miny, heights[a][b]);
+                maxy = MAX(maxy, heights[a][b]);
+            }
+        }
+    }
+    int floor = miny - 1;
+    for (int a = 0; a < LOD_SIZE; a++) {
+        for (int b = 0; b < LOD_SIZE; b++) {
+            int h = heights[a][b];
+            if (h < 0) {
+                continue;
+            }
+            faces += 1;
+            faces += lod_height(heights, a - 1, b, floor) < h;
+            faces += lod_height(heights, a + 1, b, floor) < h;
+            faces += lod_height(heights, a, b - 1, floor) < h;
+            faces += lod_height(heights, a, b + 1, floor) < h;
+        }
+    }
+
+    // generate geometry
+    GLfloat *data = malloc_faces(10, faces);
+    float ao[6][4] = {0};
+    float light[6][4] = {0};
+    int offset = 0;
+    for (int a = 0; a < LOD_SIZE; a++) {
+        for (int b = 0; b < LOD_SIZE; b++) {
+            int h = heights[a][b];
+            if (h < 0) {
+                continue;
+            }
+            int w = blocks[a][b];
+            float x1 = ox + a * LOD_STEP - 0.5;
+            float z1 = oz + b * LOD_STEP - 0.5;
+            float x2 = x1 + LOD_STEP;
+            float z2 = z1 + LOD_STEP;
+            make_box(
+                data + offset, ao, light,
+                0, 0, 1, 0, 0, 0,
+                x1, h - 0.5, z1, x2, h + 0.5, z2, w);
+            offset += 60;
+            int sides[4] = {
+                lod_height(heights, a - 1, b, floor),
+                lod_height(heights, a + 1, b, floor),
+                lod_height(heights, a, b - 1, floor),
+                lod_height(heights, a, b + 1, floor)
+            };
+            for (int i = 0; i < 4; i++) {
+                if (sides[i] >= h) {
+                    continue;
+                }
+                make_box(
+                    data + offset, ao, light,
+                    i == 0, i == 1, 0, 0, i == 2, i == 3,
+                    x1, sides[i] + 0.5, z1, x2, h + 0.5, z2, w);
+                offset += 60;
+            }
+        }
+    }
+
+    item->miny = floor;
+    item->maxy = maxy;
+    item->faces = faces;
+    item->data = data;
+}
+
+void on_chunk_key(int p, int q, int key) {
     client_chunk(p, q, key);
 }
 
+void request_chunk(int p, int q) {
+    if (get_client_enabled()) {
+        db_get_key(p, q, on_chunk_key);
+    }
+}
+
+int chunk_bytes(Chunk *chunk) {
+    int faces = chunk->faces + chunk->cutout_faces +
+        chunk->plant_tiers[PLANT_TIERS - 1];
+    int bytes = faces * 60 * sizeof(GLfloat);
+    bytes += chunk->sign_faces * 30 * sizeof(GLfloat);
+    if (chunk->cold_map) {
+        bytes += chunk->cold_map_size + chunk->cold_lights_size;
+    }
+    else {
+        bytes += (chunk->map.mask + 1) * sizeof(MapEntry);
+        bytes += (chunk->lights.mask + 1) * sizeof(MapEntry);
+    }
+    bytes += chunk->signs.capacity * sizeof(Sign);
+    return bytes;
+}
+
+// keeps an evicted chunk's blocks, lights, signs and uploaded mesh so that
+// walking back over the delete radius needs neither worldgen nor the db
+void cache_chunk(Chunk *chunk) {
+    if (!chunk->loaded || CHUNK_CACHE_BYTES <= 0) {
+        free_chunk(chunk);
+        return;
+    }
+    if (chunk->upload) {
+        free(chunk->upload_data);
+        free(chunk->upload_sign_data);
+        free(chunk->upload_cutout_data);
+        free(chunk->upload_plant_data);
+        chunk->upload_data = 0;
+        chunk->upload_sign_data = 0;
+        chunk->upload_cutout_data = 0;
+        chunk->upload_plant_data = 0;
+        chunk->upload = 0;
+        chunk->dirty = 1;
+        chunk->sign_dirty = 1;
+    }
+    // a mesh still being built for it will be thrown away
+    for (int i = 0; i < WORKERS; i++) {
+        Worker *worker = g->workers + i;
+        mtx_lock(&worker->mtx);
+        WorkerItem *item = &worker->item;
+        if (worker->state != WORKER_IDLE && !item->lod &&
+            item->p == chunk->p && item->q == chunk->q)
+        {
+            chunk->dirty = 1;
+            chunk->sign_dirty = 1;
+        }
+        mtx_unlock(&worker->mtx);
+    }
+    if (CHUNK_CACHE_COMPRESS) {
+        freeze_chunk(chunk);
+    }
+    CachedChunk entry = {0};
+    memcpy(&entry.chunk, chunk, sizeof(Chunk));
+    entry.bytes = chunk_bytes(chunk);
+    entry.used = ++g->cache_clock;
+    while (g->cached_count && (g->cached_count == MAX_CACHED_CHUNKS ||
+        g->cached_bytes + entry.bytes > CHUNK_CACHE_BYTES))
+    {
+        CachedChunk *oldest = g->cached_chunks;
+        for (int i = 1; i < g->cached_count; i++) {
+            CachedChunk *other = g->cached_chunks + i;
+            if (other->used < oldest->used) {
+                oldest = other;
+            }
+        }
+        free_cached_chunk(oldest);
+    }
+    if (entry.bytes > CHUNK_CACHE_BYTES) {
+        free_chunk(&entry.chunk);
+        return;
+    }
+    memcpy(g->cached_chunks + g->cached_count++, &entry, sizeof(CachedChunk));
+    g->cached_bytes += entry.bytes;
+}
+
+int revive_chunk(Chunk *chunk, int p, int q) {
+    CachedChunk *entry = find_cached_chunk(p, q);
+    if (!entry) {
+        g->cache_misses++;
+        return 0;
+    }
+    g->cache_hits++;
+    memcpy(chunk, &entry->chunk, sizeof(Chunk));
+    remove_cached_chunk(entry);
+    if (chunk->edge_edits) {
+        dirty_neighbors(p, q);
+    }
+    request_chunk(p, q);
+    return 1;
+}
+
 void init_chunk(Chunk *chunk, int p, int q) {
     chunk->p = p;
     chunk->q = q;
@@ -1207,10 +2124,24 @@ void init_chunk(Chunk *chunk, int p, int q) {
     chunk->sign_faces = 0;
     chunk->buffer = 0;
     chunk->sign_buffer = 0;
+    chunk->cutout_buffer = 0;
+    chunk->cutout_faces = 0;
+    chunk->plant_buffer = 0;
+    memset(chunk->plant_tiers, 0, sizeof(chunk->plant_tiers));
+    chunk->upload = 0;
+    chunk->upload_data = 0;
+    chunk->upload_sign_data = 0;
+    chunk->upload_cutout_data = 0;
+    chunk->upload_plant_data = 0;
+    chunk->requested = glfwGetTime();
+    chunk->loaded = 0;
+    chunk->edge_edits = 0;
+    chunk->cold_map = 0;
+    chunk->cold_lights = 0;
+    chunk->sign_dirty = 1;
     dirty_chunk(chunk);
     SignList *signs = &chunk->signs;
     sign_list_alloc(signs, 16);
-    db_load_signs(signs, p, q);
     Map *block_map = &chunk->map;
     Map *light_map = &chunk->lights;
     int dx = p * CHUNK_SIZE - 1;
@@ -1221,6 +2152,9 @@ void init_chunk(Chunk *chunk, int p, int q) {
 }
 
 void create_chunk(Chunk *chunk, int p, int q) {
+    if (revive_chunk(chunk, p, q)) {
+        return;
+    }
     init_chunk(chunk, p, q);
 
     WorkerItem _item;
@@ -1229,7 +2163,13 @@ void create_chunk(Chunk *chunk, int p, int q) {
     item->q = chunk->q;
     item->block_maps[1][1] = &chunk->map;
     item->light_maps[1][1] = &chunk->lights;
-    load_chunk(item);
+    item->signs = &chunk->signs;
+    load_chunk(item, 0);
+    chunk->loaded = 1;
+    chunk->edge_edits = item->edge_edits;
+    if (chunk->edge_edits) {
+        dirty_neighbors(p, q);
+    }
 
     request_chunk(p, q);
 }
@@ -1240,24 +2180,27 @@ void delete_chunks() {
     State *s2 = &(g->players + g->observe1)->state;
     State *s3 = &(g->players + g->observe2)->state;
     State *states[3] = {s1, s2, s3};
+    int freezes = 0;
     for (int i = 0; i < count; i++) {
         Chunk *chunk = g->chunks + i;
-        int delete = 1;
+        int distance = g->delete_radius;
         for (int j = 0; j < 3; j++) {
             State *s = states[j];
             int p = chunked(s->x);
             int q = chunked(s->z);
-            if (chunk_distance(chunk, p, q) < g->delete_radius) {
-                delete = 0;
-                break;
-            }
+            distance = MIN(distance, chunk_distance(chunk, p, q));
+        }
+        int delete = distance >= g->delete_radius;
+        // one ring past the create radius is still read by the mesher
+        if (!delete && distance > g->create_radius + 1 && chunk->loaded &&
+            !chunk->cold_map && freezes < CHUNK_FREEZE_RATE)
+        {
+            freeze_chunk(chunk);
+            freezes++;
         }
         if (delete) {
-            map_free(&chunk->map);
-            map_free(&chunk->lights);
-            sign_list_free(&chunk->signs);
-            del_buffer(chunk->buffer);
-            del_buffer(chunk->sign_buffer);
+            db_touch_chunk(chunk->p, chunk->q);
+            cache_chunk(chunk);
             Chunk *other = g->chunks + (--count);
             memcpy(chunk, other, sizeof(Chunk));
         }
@@ -1265,22 +2208,74 @@ void delete_chunks() {
     g->chunk_count = count;
 }
 
-void delete_all_chunks() {
+// the cache database evicts by last use, which get_key alone only records
+// when a chunk is first requested
+void touch_chunks() {
     for (int i = 0; i < g->chunk_count; i++) {
         Chunk *chunk = g->chunks + i;
-        map_free(&chunk->map);
-        map_free(&chunk->lights);
-        sign_list_free(&chunk->signs);
-        del_buffer(chunk->buffer);
-        del_buffer(chunk->sign_buffer);
+        db_touch_chunk(chunk->p, chunk->q);
+    }
+}
+
+void delete_all_chunks() {
+    for (int i = 0; i < g->chunk_count; i++) {
+        free_chunk(g->chunks + i);
     }
     g->chunk_count = 0;
+    delete_cached_chunks();
+}
+
+void delete_lods() {
+    int count = g->lod_count;
+    State *s = &g->players->state;
+    int p = chunked(s->x);
+    int q = chunked(s->z);
+    for (int i = 0; i < count; i++) {
+        Lod *lod = g->lods + i;
+        int distance = MAX(ABS(lod->p - p), ABS(lod->q - q));
+        if (distance < g->render_radius - 1 ||
+            distance > get_view_radius() + 1)
+        {
+            free(lod->upload_data);
+            del_buffer_later(lod->buffer);
+            Lod *other = g->lods + (--count);
+            memcpy(lod, other, sizeof(Lod));
+            i--;
+        }
+    }
+    g->lod_count = count;
+}
+
+void delete_all_lods() {
+    for (int i = 0; i < g->lod_count; i++) {
+        Lod *lod = g->lods + i;
+        free(lod->upload_data);
+        del_buffer_later(lod->buffer);
+    }
+    g->lod_count = 0;
 }
 
 void check_workers() {
+    db_complete();
     for (int i = 0; i < WORKERS; i++) {
         Worker *worker = g->workers + i;
         mtx_lock(&worker->mtx);
+        if (worker->state == WORKER_DONE && worker->item.lod) {
+            WorkerItem *item = &worker->item;
+            Lod *lod = find_lod(item->p, item->q);
+            if (lod) {
+                lod->miny = item->miny;
+                lod->maxy = item->maxy;
+                free(lod->upload_data);
+                lod->upload_faces = item->faces;
+                lod->upload_data = item->data;
+                lod->upload = 1;
+            }
+            else {
+                free(item->data);
+            }
+            worker->state = WORKER_IDLE;
+        }
         if (worker->state == WORKER_DONE) {
             WorkerItem *item = &worker->item;
             Chunk *chunk = find_chunk(item->p, item->q);
@@ -1292,10 +2287,35 @@ void check_workers() {
                     map_free(&chunk->lights);
                     map_copy(&chunk->map, block_map);
                     map_copy(&chunk->lights, light_map);
+                    // signs set while the chunk was loading win over the db
+                    SignList *signs = &chunk->signs;
+                    for (int j = 0; j < signs->size; j++) {
+                        Sign *e = signs->data + j;
+                        sign_list_add(
+                            item->signs, e->x, e->y, e->z, e->face, e->text);
+                        chunk->sign_dirty = 1;
+                    }
+                    sign_list_free(signs);
+                    sign_list_copy(signs, item->signs);
+                    chunk->loaded = 1;
+                    chunk->edge_edits = item->edge_edits;
+                    if (chunk->edge_edits) {
+                        dirty_neighbors(item->p, item->q);
+                    }
                     request_chunk(item->p, item->q);
                 }
                 generate_chunk(chunk, item);
             }
+            else {
+                free(item->data);
+                free(item->sign_data);
+                free(item->cutout_data);
+                free(item->plant_data);
+            }
+            if (item->signs) {
+                sign_list_free(item->signs);
+                free(item->signs);
+            }
             for (int a = 0; a < 3; a++) {
                 for (int b = 0; b < 3; b++) {
                     Map *block_map = item->block_maps[a][b];
@@ -1327,7 +2347,7 @@ void force_chunks(Player *player) {
             int b = q + dq;
             Chunk *chunk = find_chunk(a, b);
             if (chunk) {
-                if (chunk->dirty) {
+                if (chunk->dirty || chunk->sign_dirty) {
                     gen_chunk_buffer(chunk);
                 }
             }
@@ -1340,14 +2360,8 @@ void force_chunks(Player *player) {
     }
 }
 
-void ensure_chunks_worker(Player *player, Worker *worker) {
+int ensure_chunks_worker(Player *player, Snapshot *view, Worker *worker) {
     State *s = &player->state;
-    float matrix[16];
-    set_matrix_3d(
-        matrix, g->width, g->height,
-        s->x, s->y, s->z, s->rx, s->ry, g->fov, g->ortho, g->render_radius);
-    float planes[6][4];
-    frustum_planes(planes, g->render_radius, matrix);
     int p = chunked(s->x);
     int q = chunked(s->z);
     int r = g->create_radius;
@@ -1364,14 +2378,14 @@ void ensure_chunks_worker(Player *player, Worker *worker) {
                 continue;
             }
             Chunk *chunk = find_chunk(a, b);
-            if (chunk && !chunk->dirty) {
+            if (chunk && !chunk->dirty && !chunk->sign_dirty) {
                 continue;
             }
             int distance = MAX(ABS(dp), ABS(dq));
-            int invisible = !chunk_visible(planes, a, b, 0, 256);
+            int invisible = !chunk_visible(view->planes, a, b, 0, 256);
             int priority = 0;
             if (chunk) {
-                priority = chunk->buffer && chunk->dirty;
+                priority = chunk->buffer && (chunk->dirty || chunk->sign_dirty);
             }
             int score = (invisible << 24) | (priority << 16) | distance;
             if (score < best_score) {
@@ -1381,63 +2395,290 @@ void ensure_chunks_worker(Player *player, Worker *worker) {
             }
         }
     }
+    // chunks around the predicted position rank after visible chunks but
+    // before the ones behind the camera
+    int pp = player->prefetch_p;
+    int pq = player->prefetch_q;
+    for (int dp = -r; player->prefetch && dp <= r; dp++) {
+        for (int dq = -r; dq <= r; dq++) {
+            int a = pp + dp;
+            int b = pq + dq;
+            int distance = MAX(ABS(a - p), ABS(b - q));
+            if (distance <= r || distance >= g->delete_radius) {
+                continue;
+            }
+            int index = (ABS(a) ^ ABS(b)) % WORKERS;
+            if (index != worker->index) {
+                continue;
+            }
+            Chunk *chunk = find_chunk(a, b);
+            if (chunk && !chunk->dirty && !chunk->sign_dirty) {
+                continue;
+            }
+            int score = (1 << 23) | MAX(ABS(dp), ABS(dq));
+            if (score < best_score) {
+                best_score = score;
+                best_a = a;
+                best_b = b;
+            }
+        }
+    }
+    if (best_score == start) {
+        return 0;
+    }
+    int a = best_a;
+    int b = best_b;
+    int load = 0;
+    Chunk *chunk = find_chunk(a, b);
+    if (!chunk) {
+        if (g->chunk_count >= MAX_CHUNKS) {
+            return 0;
+        }
+        chunk = g->chunks + g->chunk_count++;
+        if (!revive_chunk(chunk, a, b)) {
+            load = 1;
+            init_chunk(chunk, a, b);
+        }
+        else if (!chunk->dirty && !chunk->sign_dirty) {
+            return 1;
+        }
+    }
+    WorkerItem *item = &worker->item;
+    item->p = chunk->p;
+    item->q = chunk->q;
+    item->load = load;
+    item->lod = 0;
+    for (int dp = -1; dp <= 1; dp++) {
+        for (int dq = -1; dq <= 1; dq++) {
+            Chunk *other = chunk;
+            if (dp || dq) {
+                other = find_chunk(chunk->p + dp, chunk->q + dq);
+            }
+            if (other && chunk->dirty && (other == chunk || other->loaded)) {
+                thaw_chunk(other);
+                Map *block_map = malloc(sizeof(Map));
+                map_copy(block_map, &other->map);
+                Map *light_map = malloc(sizeof(Map));
+                map_copy(light_map, &other->lights);
+                item->block_maps[dp + 1][dq + 1] = block_map;
+                item->light_maps[dp + 1][dq + 1] = light_map;
+            }
+            else {
+                item->block_maps[dp + 1][dq + 1] = 0;
+                item->light_maps[dp + 1][dq + 1] = 0;
+            }
+        }
+    }
+    item->data = 0;
+    item->cutout_data = 0;
+    item->plant_data = 0;
+    item->sign_data = 0;
+    item->signs = 0;
+    if (chunk->sign_dirty) {
+        SignList *signs = malloc(sizeof(SignList));
+        sign_list_copy(signs, &chunk->signs);
+        item->signs = signs;
+    }
+    chunk->dirty = 0;
+    chunk->sign_dirty = 0;
+    worker->state = WORKER_BUSY;
+    cnd_signal(&worker->cnd);
+    return 1;
+}
+
+void ensure_lods_worker(
+    Player *player, Snapshot *view, Worker *worker, char *grid)
+{
+    State *s = &player->state;
+    int radius = get_view_radius();
+    int p = chunked(s->x);
+    int q = chunked(s->z);
+    int r = radius;
+    int size = r * 2 + 1;
+    int start = 0x0fffffff;
+    int best_score = start;
+    int best_a = 0;
+    int best_b = 0;
+    for (int dp = -r; dp <= r; dp++) {
+        for (int dq = -r; dq <= r; dq++) {
+            int distance = MAX(ABS(dp), ABS(dq));
+            if (distance <= g->render_radius) {
+                continue;
+            }
+            int a = p + dp;
+            int b = q + dq;
+            int index = (ABS(a) ^ ABS(b)) % WORKERS;
+            if (index != worker->index) {
+                continue;
+            }
+            if (grid[(dp + r) * size + (dq + r)] == 1) {
+                continue;
+            }
+            int invisible = !chunk_visible(view->planes, a, b, 0, 256);
+            int score = (invisible << 24) | distance;
+            if (score < best_score) {
+                best_score = score;
+                best_a = a;
+                best_b = b;
+            }
+        }
+    }
     if (best_score == start) {
         return;
     }
-    int a = best_a;
-    int b = best_b;
-    int load = 0;
-    Chunk *chunk = find_chunk(a, b);
-    if (!chunk) {
-        load = 1;
-        if (g->chunk_count < MAX_CHUNKS) {
-            chunk = g->chunks + g->chunk_count++;
-            init_chunk(chunk, a, b);
-        }
-        else {
-            return;
+    int a = best_a;
+    int b = best_b;
+    Lod *lod = find_lod(a, b);
+    if (!lod) {
+        if (g->lod_count >= MAX_LODS) {
+            return;
+        }
+        lod = g->lods + g->lod_count++;
+        lod->p = a;
+        lod->q = b;
+        lod->faces = 0;
+        lod->miny = 0;
+        lod->maxy = 0;
+        lod->buffer = 0;
+        lod->upload = 0;
+        lod->upload_data = 0;
+    }
+    lod->dirty = 0;
+    grid[(a - p + r) * size + (b - q + r)] = 1;
+    WorkerItem *item = &worker->item;
+    item->p = a;
+    item->q = b;
+    item->load = 0;
+    item->lod = 1;
+    for (int dp = 0; dp < 3; dp++) {
+        for (int dq = 0; dq < 3; dq++) {
+            item->block_maps[dp][dq] = 0;
+            item->light_maps[dp][dq] = 0;
+        }
+    }
+    item->signs = 0;
+    item->data = 0;
+    item->cutout_data = 0;
+    item->plant_data = 0;
+    item->sign_data = 0;
+    worker->state = WORKER_BUSY;
+    cnd_signal(&worker->cnd);
+}
+
+void update_prefetch(Player *player) {
+    State *s = &player->state;
+    double now = glfwGetTime();
+    double dt = now - player->seen.t;
+    if (!player->seen_valid || dt < 0) {
+        // the clock jumps on time sync, start a new estimate
+        player->seen = *s;
+        player->seen.t = now;
+        player->seen_valid = 1;
+        player->vx = player->vz = 0;
+    }
+    else if (dt >= 0.25) {
+        float vx = (s->x - player->seen.x) / dt;
+        float vz = (s->z - player->seen.z) / dt;
+        if (ABS(vx) > PREFETCH_MAX_SPEED || ABS(vz) > PREFETCH_MAX_SPEED) {
+            // teleported, not moving
+            vx = vz = 0;
+            player->vx = player->vz = 0;
+        }
+        player->vx = (player->vx + vx) / 2;
+        player->vz = (player->vz + vz) / 2;
+        player->seen = *s;
+        player->seen.t = now;
+    }
+    int p = chunked(s->x);
+    int q = chunked(s->z);
+    int m = g->delete_radius - g->create_radius - 1;
+    int dp = chunked(s->x + player->vx * PREFETCH_SECONDS) - p;
+    int dq = chunked(s->z + player->vz * PREFETCH_SECONDS) - q;
+    player->prefetch_p = p + MAX(-m, MIN(m, dp));
+    player->prefetch_q = q + MAX(-m, MIN(m, dq));
+    player->prefetch =
+        player->prefetch_p != p || player->prefetch_q != q;
+    if (!player->prefetch) {
+        return;
+    }
+    int count = 0;
+    for (int i = 0; i < g->chunk_count; i++) {
+        if (chunk_distance(g->chunks + i, p, q) > g->create_radius) {
+            count++;
         }
     }
-    WorkerItem *item = &worker->item;
-    item->p = chunk->p;
-    item->q = chunk->q;
-    item->load = load;
-    for (int dp = -1; dp <= 1; dp++) {
-        for (int dq = -1; dq <= 1; dq++) {
-            Chunk *other = chunk;
-            if (dp || dq) {
-                other = find_chunk(chunk->p + dp, chunk->q + dq);
-            }
-            if (other) {
-                Map *block_map = malloc(sizeof(Map));
-                map_copy(block_map, &other->map);
-                Map *light_map = malloc(sizeof(Map));
-                map_copy(light_map, &other->lights);
-                item->block_maps[dp + 1][dq + 1] = block_map;
-                item->light_maps[dp + 1][dq + 1] = light_map;
-            }
-            else {
-                item->block_maps[dp + 1][dq + 1] = 0;
-                item->light_maps[dp + 1][dq + 1] = 0;
+    if (count >= PREFETCH_CHUNK_LIMIT) {
+        player->prefetch = 0;
+    }
+}
+
+void prefetch_burst(Player *player) {
+    State *s = &player->state;
+    int p = chunked(s->x);
+    int q = chunked(s->z);
+    player->seen = *s;
+    player->seen.t = glfwGetTime();
+    player->seen_valid = 1;
+    player->vx = player->vz = 0;
+    delete_chunks();
+    for (int r = 0; r <= PREFETCH_BURST_RADIUS; r++) {
+        for (int dp = -r; dp <= r; dp++) {
+            for (int dq = -r; dq <= r; dq++) {
+                if (MAX(ABS(dp), ABS(dq)) != r) {
+                    continue;
+                }
+                Chunk *chunk = find_chunk(p + dp, q + dq);
+                if (chunk && !chunk->dirty && !chunk->sign_dirty) {
+                    continue;
+                }
+                if (!chunk) {
+                    if (g->chunk_count >= MAX_CHUNKS) {
+                        return;
+                    }
+                    chunk = g->chunks + g->chunk_count++;
+                    create_chunk(chunk, p + dp, q + dq);
+                }
+                gen_chunk_buffer(chunk);
+                // let the render thread upload what is ready so far
+                yield_model();
             }
         }
     }
-    chunk->dirty = 0;
-    worker->state = WORKER_BUSY;
-    cnd_signal(&worker->cnd);
 }
 
-void ensure_chunks(Player *player) {
+void ensure_chunks(Player *player, Snapshot *view) {
     check_workers();
     force_chunks(player);
+    update_prefetch(player);
+    char *grid = 0;
+    int r = get_view_radius();
+    int size = r * 2 + 1;
+    if (g->lod_radius) {
+        // 0 = missing, 1 = built or building, 2 = dirty
+        State *s = &player->state;
+        int p = chunked(s->x);
+        int q = chunked(s->z);
+        grid = calloc(size * size, sizeof(char));
+        for (int i = 0; i < g->lod_count; i++) {
+            Lod *lod = g->lods + i;
+            int dp = lod->p - p;
+            int dq = lod->q - q;
+            if (ABS(dp) <= r && ABS(dq) <= r) {
+                grid[(dp + r) * size + (dq + r)] = lod->dirty ? 2 : 1;
+            }
+        }
+    }
     for (int i = 0; i < WORKERS; i++) {
         Worker *worker = g->workers + i;
         mtx_lock(&worker->mtx);
         if (worker->state == WORKER_IDLE) {
-            ensure_chunks_worker(player, worker);
+            if (!ensure_chunks_worker(player, view, worker) && grid) {
+                ensure_lods_worker(player, view, worker, grid);
+            }
         }
         mtx_unlock(&worker->mtx);
     }
+    free(grid);
 }
 
 int worker_run(void *arg) {
@@ -1450,10 +2691,18 @@ int worker_run(void *arg) {
         }
         mtx_unlock(&worker->mtx);
         WorkerItem *item = &worker->item;
+        if (item->lod) {
+            compute_lod(item, worker->index + 1);
+        }
         if (item->load) {
-            load_chunk(item);
+            load_chunk(item, worker->index + 1);
+        }
+        if (item->block_maps[1][1]) {
+            compute_chunk(item);
+        }
+        if (item->signs) {
+            compute_signs(item);
         }
-        compute_chunk(item);
         mtx_lock(&worker->mtx);
         worker->state = WORKER_DONE;
         mtx_unlock(&worker->mtx);
@@ -1468,11 +2717,12 @@ void unset_sign(int x, int y, int z) {
     if (chunk) {
         SignList *signs = &chunk->signs;
         if (sign_list_remove_all(signs, x, y, z)) {
-            chunk->dirty = 1;
+            chunk->sign_dirty = 1;
             db_delete_signs(x, y, z);
         }
     }
     else {
+        drop_cached_chunk(p, q);
         db_delete_signs(x, y, z);
     }
 }
@@ -1484,11 +2734,12 @@ void unset_sign_face(int x, int y, int z, int face) {
     if (chunk) {
         SignList *signs = &chunk->signs;
         if (sign_list_remove(signs, x, y, z, face)) {
-            chunk->dirty = 1;
+            chunk->sign_dirty = 1;
             db_delete_sign(x, y, z, face);
         }
     }
     else {
+        drop_cached_chunk(p, q);
         db_delete_sign(x, y, z, face);
     }
 }
@@ -1505,9 +2756,12 @@ void _set_sign(
         SignList *signs = &chunk->signs;
         sign_list_add(signs, x, y, z, face, text);
         if (dirty) {
-            chunk->dirty = 1;
+            chunk->sign_dirty = 1;
         }
     }
+    else {
+        drop_cached_chunk(p, q);
+    }
     db_insert_sign(p, q, x, y, z, face, text);
 }
 
@@ -1523,6 +2777,7 @@ void toggle_light(int x, int y, int z) {
     int q = chunked(z);
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
+        thaw_chunk(chunk);
         Map *map = &chunk->lights;
         int w = map_get(map, x, y, z) ? 0 : 15;
         map_set(map, x, y, z, w);
@@ -1535,6 +2790,7 @@ void toggle_light(int x, int y, int z) {
 void set_light(int p, int q, int x, int y, int z, int w) {
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
+        thaw_chunk(chunk);
         Map *map = &chunk->lights;
         if (map_set(map, x, y, z, w)) {
             dirty_chunk(chunk);
@@ -1542,6 +2798,7 @@ void set_light(int p, int q, int x, int y, int z, int w) {
         }
     }
     else {
+        drop_cached_chunk(p, q);
         db_insert_light(p, q, x, y, z, w);
     }
 }
@@ -1549,17 +2806,30 @@ void set_light(int p, int q, int x, int y, int z, int w) {
 void _set_block(int p, int q, int x, int y, int z, int w, int dirty) {
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
+        thaw_chunk(chunk);
         Map *map = &chunk->map;
         if (map_set(map, x, y, z, w)) {
             if (dirty) {
                 dirty_chunk(chunk);
             }
+            int dx = x - p * CHUNK_SIZE;
+            int dz = z - q * CHUNK_SIZE;
+            if (dx == 0 || dx == CHUNK_SIZE - 1 ||
+                dz == 0 || dz == CHUNK_SIZE - 1)
+            {
+                chunk->edge_edits = 1;
+            }
             db_insert_block(p, q, x, y, z, w);
         }
     }
     else {
+        drop_cached_chunk(p, q);
         db_insert_block(p, q, x, y, z, w);
     }
+    Lod *lod = find_lod(p, q);
+    if (lod) {
+        lod->dirty = 1;
+    }
     if (w == 0 && chunked(x) == p && chunked(z) == q) {
         unset_sign(x, y, z);
         set_light(p, q, x, y, z, 0);
@@ -1570,6 +2840,7 @@ void set_block(int x, int y, int z, int w) {
     int p = chunked(x);
     int q = chunked(z);
     _set_block(p, q, x, y, z, w, 1);
+    int edge = 0;
     for (int dx = -1; dx <= 1; dx++) {
         for (int dz = -1; dz <= 1; dz++) {
             if (dx == 0 && dz == 0) {
@@ -1581,7 +2852,20 @@ void set_block(int x, int y, int z, int w) {
             if (dz && chunked(z + dz) == q) {
                 continue;
             }
-            _set_block(p + dx, q + dz, x, y, z, -w, 1);
+            Chunk *other = find_chunk(p + dx, q + dz);
+            if (other) {
+                other->dirty = 1;
+            }
+            else {
+                stale_cached_chunk(p + dx, q + dz);
+            }
+            edge = 1;
+        }
+    }
+    if (edge) {
+        Chunk *chunk = find_chunk(p, q);
+        if (chunk) {
+            chunk->edge_edits = 1;
         }
     }
     client_block(x, y, z, w);
@@ -1600,6 +2884,7 @@ int get_block(int x, int y, int z) {
     int q = chunked(z);
     Chunk *chunk = find_chunk(p, q);
     if (chunk) {
+        thaw_chunk(chunk);
         Map *map = &chunk->map;
         return map_get(map, x, y, z);
     }
@@ -1607,6 +2892,7 @@ int get_block(int x, int y, int z) {
 }
 
 void builder_block(int x, int y, int z, int w) {
+    static int count = 0;
     if (y <= 0 || y >= 256) {
         return;
     }
@@ -1616,33 +2902,53 @@ void builder_block(int x, int y, int z, int w) {
     if (w) {
         set_block(x, y, z, w);
     }
+    // big builds run on the simulation thread; keep frames coming
+    if (++count % 1024 == 0) {
+        yield_model();
+    }
 }
 
-int render_chunks(Attrib *attrib, Player *player) {
-    int result = 0;
+// plants are sorted into tiers by a position hash, so drawing a prefix of
+// the plant buffer keeps an evenly spread subset
+int plant_faces_at(Chunk *chunk, int distance) {
+    if (distance > g->plant_radius) {
+        return 0;
+    }
+    int tiers = PLANT_TIERS;
+    if (PLANT_THINNING) {
+        tiers -= distance * PLANT_TIERS / (g->plant_radius + 1);
+    }
+    return chunk->plant_tiers[MAX(tiers, 1) - 1];
+}
+
+void snapshot_view(
+    Snapshot *view, Player *player, int width, int height, int ortho,
+    float fov)
+{
     State *s = &player->state;
-    ensure_chunks(player);
+    memcpy(&view->state, s, sizeof(State));
+    view->width = width;
+    view->height = height;
+    view->ortho = ortho;
+    view->fov = fov;
     int p = chunked(s->x);
     int q = chunked(s->z);
-    float light = get_daylight();
-    float matrix[16];
     set_matrix_3d(
-        matrix, g->width, g->height,
-        s->x, s->y, s->z, s->rx, s->ry, g->fov, g->ortho, g->render_radius);
-    float planes[6][4];
-    frustum_planes(planes, g->render_radius, matrix);
-    glUseProgram(attrib->program);
-    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
-    glUniform3f(attrib->camera, s->x, s->y, s->z);
-    glUniform1i(attrib->sampler, 0);
-    glUniform1i(attrib->extra1, 2);
-    glUniform1f(attrib->extra2, light);
-    glUniform1f(attrib->extra3, g->render_radius * CHUNK_SIZE);
-    glUniform1i(attrib->extra4, g->ortho);
-    glUniform1f(attrib->timer, time_of_day());
+        view->matrix, width, height,
+        s->x, s->y, s->z, s->rx, s->ry, fov, ortho, get_view_radius());
+    set_matrix_3d(
+        view->sky_matrix, width, height,
+        0, 0, 0, s->rx, s->ry, fov, 0, get_view_radius());
+    float (*planes)[4] = view->planes;
+    frustum_planes(planes, get_view_radius(), view->matrix);
+    view->faces = 0;
+    view->mesh_count = 0;
+    view->cutout_count = 0;
+    view->sign_count = 0;
     for (int i = 0; i < g->chunk_count; i++) {
         Chunk *chunk = g->chunks + i;
-        if (chunk_distance(chunk, p, q) > g->render_radius) {
+        int distance = chunk_distance(chunk, p, q);
+        if (distance > g->render_radius) {
             continue;
         }
         if (!chunk_visible(
@@ -1650,117 +2956,169 @@ int render_chunks(Attrib *attrib, Player *player) {
         {
             continue;
         }
-        draw_chunk(attrib, chunk);
-        result += chunk->faces;
+        if (chunk->faces) {
+            Mesh *mesh = view->meshes + view->mesh_count++;
+            mesh->buffer = chunk->buffer;
+            mesh->faces = chunk->faces;
+            view->faces += chunk->faces;
+        }
+        if (chunk->cutout_faces) {
+            Mesh *mesh = view->cutouts + view->cutout_count++;
+            mesh->buffer = chunk->cutout_buffer;
+            mesh->faces = chunk->cutout_faces;
+            view->faces += chunk->cutout_faces;
+        }
+        int plant_faces = plant_faces_at(chunk, distance);
+        if (plant_faces) {
+            Mesh *mesh = view->cutouts + view->cutout_count++;
+            mesh->buffer = chunk->plant_buffer;
+            mesh->faces = plant_faces;
+            view->faces += plant_faces;
+        }
+        if (distance <= g->sign_radius && chunk->sign_faces) {
+            Mesh *mesh = view->signs + view->sign_count++;
+            mesh->buffer = chunk->sign_buffer;
+            mesh->faces = chunk->sign_faces;
+        }
+    }
+    for (int i = 0; i < g->lod_count; i++) {
+        Lod *lod = g->lods + i;
+        int distance = MAX(ABS(lod->p - p), ABS(lod->q - q));
+        if (distance <= g->render_radius || distance > get_view_radius()) {
+            continue;
+        }
+        if (!chunk_visible(planes, lod->p, lod->q, lod->miny, lod->maxy)) {
+            continue;
+        }
+        // LOD tops can be leaves or glass, so they need the cutout shader
+        Mesh *mesh = view->cutouts + view->cutout_count++;
+        mesh->buffer = lod->buffer;
+        mesh->faces = lod->faces;
+        view->faces += lod->faces;
+    }
+    view->player_count = 0;
+    for (int i = 0; i < g->player_count; i++) {
+        Player *other = g->players + i;
+        if (other != player) {
+            State *o = &other->state;
+            GLfloat *d = view->players + view->player_count++ * 5;
+            d[0] = o->x; d[1] = o->y; d[2] = o->z; d[3] = o->rx; d[4] = o->ry;
+        }
+    }
+    int hw = hit_test(
+        0, s->x, s->y, s->z, s->rx, s->ry, &view->hx, &view->hy, &view->hz);
+    view->hit = is_obstacle(hw);
+    view->sign_hit = 0;
+    if (g->typing && g->typing_buffer[0] == CRAFT_KEY_SIGN) {
+        view->sx = view->hx;
+        view->sy = view->hy;
+        view->sz = view->hz;
+        view->sign_hit = _hit_test_face(
+            s, hw, view->hx, view->hy, view->hz, &view->sign_face);
+        strncpy(view->sign_text, g->typing_buffer + 1, MAX_SIGN_LENGTH);
+        view->sign_text[MAX_SIGN_LENGTH - 1] = '\0';
+    }
+    view->name[0] = '\0';
+    if (player != g->players) {
+        strncpy(view->name, player->name, MAX_NAME_LENGTH);
+    }
+    view->target[0] = '\0';
+    Player *other = player_crosshair(player);
+    if (other) {
+        strncpy(view->target, other->name, MAX_NAME_LENGTH);
     }
-    return result;
 }
 
-void render_signs(Attrib *attrib, Player *player) {
-    State *s = &player->state;
-    int p = chunked(s->x);
-    int q = chunked(s->z);
-    float matrix[16];
-    set_matrix_3d(
-        matrix, g->width, g->height,
-        s->x, s->y, s->z, s->rx, s->ry, g->fov, g->ortho, g->render_radius);
-    float planes[6][4];
-    frustum_planes(planes, g->render_radius, matrix);
+void chunk_uniforms(Attrib *attrib, Snapshot *view, float *matrix) {
+    State *s = &view->state;
     glUseProgram(attrib->program);
     glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
+    glUniform3f(attrib->camera, s->x, s->y, s->z);
+    glUniform1i(attrib->sampler, 0);
+    glUniform1i(attrib->extra1, 2);
+    glUniform1f(attrib->extra2, get_daylight());
+    glUniform1f(attrib->extra3, get_view_radius() * CHUNK_SIZE);
+    glUniform1i(attrib->extra4, view->ortho);
+    glUniform1f(attrib->timer, time_of_day());
+}
+
+// opaque terrain first with a shader that never discards, then the
+// alpha-tested leaves, glass, clouds, plants and LODs on top of it
+int render_chunks(Attrib *opaque, Attrib *cutout, Snapshot *view) {
+    float *matrix = view->matrix;
+    chunk_uniforms(opaque, view, matrix);
+    for (int i = 0; i < view->mesh_count; i++) {
+        draw_mesh(opaque, view->meshes + i);
+    }
+    chunk_uniforms(cutout, view, matrix);
+    for (int i = 0; i < view->cutout_count; i++) {
+        draw_mesh(cutout, view->cutouts + i);
+    }
+    return view->faces;
+}
+
+void render_signs(Attrib *attrib, Snapshot *view) {
+    glUseProgram(attrib->program);
+    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, view->matrix);
     glUniform1i(attrib->sampler, 3);
     glUniform1i(attrib->extra1, 1);
-    for (int i = 0; i < g->chunk_count; i++) {
-        Chunk *chunk = g->chunks + i;
-        if (chunk_distance(chunk, p, q) > g->sign_radius) {
-            continue;
-        }
-        if (!chunk_visible(
-            planes, chunk->p, chunk->q, chunk->miny, chunk->maxy))
-        {
-            continue;
-        }
-        draw_signs(attrib, chunk);
+    for (int i = 0; i < view->sign_count; i++) {
+        draw_signs(attrib, view->signs + i);
     }
 }
 
-void render_sign(Attrib *attrib, Player *player) {
-    if (!g->typing || g->typing_buffer[0] != CRAFT_KEY_SIGN) {
+void render_sign(Attrib *attrib, Snapshot *view) {
+    if (!view->sign_hit) {
         return;
     }
-    int x, y, z, face;
-    if (!hit_test_face(player, &x, &y, &z, &face)) {
-        return;
-    }
-    State *s = &player->state;
-    float matrix[16];
-    set_matrix_3d(
-        matrix, g->width, g->height,
-        s->x, s->y, s->z, s->rx, s->ry, g->fov, g->ortho, g->render_radius);
     glUseProgram(attrib->program);
-    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
+    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, view->matrix);
     glUniform1i(attrib->sampler, 3);
     glUniform1i(attrib->extra1, 1);
-    char text[MAX_SIGN_LENGTH];
-    strncpy(text, g->typing_buffer + 1, MAX_SIGN_LENGTH);
-    text[MAX_SIGN_LENGTH - 1] = '\0';
+    char *text = view->sign_text;
     GLfloat *data = malloc_faces(5, strlen(text));
-    int length = _gen_sign_buffer(data, x, y, z, face, text);
+    int length = _gen_sign_buffer(
+        data, view->sx, view->sy, view->sz, view->sign_face, text);
     GLuint buffer = gen_faces(5, length, data);
     draw_sign(attrib, buffer, length);
     del_buffer(buffer);
 }
 
-void render_players(Attrib *attrib, Player *player) {
-    State *s = &player->state;
-    float matrix[16];
-    set_matrix_3d(
-        matrix, g->width, g->height,
-        s->x, s->y, s->z, s->rx, s->ry, g->fov, g->ortho, g->render_radius);
+void render_players(Attrib *attrib, Snapshot *view) {
+    State *s = &view->state;
     glUseProgram(attrib->program);
-    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
+    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, view->matrix);
     glUniform3f(attrib->camera, s->x, s->y, s->z);
     glUniform1i(attrib->sampler, 0);
+    glUniform1i(attrib->extra1, 2);
+    glUniform1f(attrib->extra2, get_daylight());
+    glUniform1f(attrib->extra3, get_view_radius() * CHUNK_SIZE);
+    glUniform1i(attrib->extra4, view->ortho);
     glUniform1f(attrib->timer, time_of_day());
-    for (int i = 0; i < g->player_count; i++) {
-        Player *other = g->players + i;
-        if (other != player) {
-            draw_player(attrib, other);
-        }
-    }
+    draw_players(attrib, view->players, view->player_count);
 }
 
-void render_sky(Attrib *attrib, Player *player, GLuint buffer) {
-    State *s = &player->state;
-    float matrix[16];
-    set_matrix_3d(
-        matrix, g->width, g->height,
-        0, 0, 0, s->rx, s->ry, g->fov, 0, g->render_radius);
+void render_sky(Attrib *attrib, Snapshot *view, GLuint buffer) {
     glUseProgram(attrib->program);
-    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
+    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, view->sky_matrix);
     glUniform1i(attrib->sampler, 2);
     glUniform1f(attrib->timer, time_of_day());
     draw_triangles_3d(attrib, buffer, 512 * 3);
 }
 
-void render_wireframe(Attrib *attrib, Player *player) {
-    State *s = &player->state;
-    float matrix[16];
-    set_matrix_3d(
-        matrix, g->width, g->height,
-        s->x, s->y, s->z, s->rx, s->ry, g->fov, g->ortho, g->render_radius);
-    int hx, hy, hz;
-    int hw = hit_test(0, s->x, s->y, s->z, s->rx, s->ry, &hx, &hy, &hz);
-    if (is_obstacle(hw)) {
-        glUseProgram(attrib->program);
-        glLineWidth(1);
-        glEnable(GL_COLOR_LOGIC_OP);
-        glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, matrix);
-        GLuint wireframe_buffer = gen_wireframe_buffer(hx, hy, hz, 0.53);
-        draw_lines(attrib, wireframe_buffer, 3, 24);
-        del_buffer(wireframe_buffer);
-        glDisable(GL_COLOR_LOGIC_OP);
+void render_wireframe(Attrib *attrib, Snapshot *view) {
+    if (!view->hit) {
+        return;
     }
+    glUseProgram(attrib->program);
+    glLineWidth(1);
+    glEnable(GL_COLOR_LOGIC_OP);
+    glUniformMatrix4fv(attrib->matrix, 1, GL_FALSE, view->matrix);
+    GLuint wireframe_buffer = gen_wireframe_buffer(
+        view->hx, view->hy, view->hz, 0.53);
+    draw_lines(attrib, wireframe_buffer, 3, 24);
+    del_buffer(wireframe_buffer);
+    glDisable(GL_COLOR_LOGIC_OP);
 }
 
 void render_crosshairs(Attrib *attrib) {
@@ -2075,15 +3433,59 @@ void parse_command(const char *buffer, int forward) {
         snprintf(g->db_path, MAX_PATH_LENGTH, "%s", DB_PATH);
     }
     else if (sscanf(buffer, "/view %d", &radius) == 1) {
-        if (radius >= 1 && radius <= 24) {
-            g->create_radius = radius;
-            g->render_radius = radius;
-            g->delete_radius = radius + 4;
+        if (radius >= 1 && radius <= MAX_VIEW_RADIUS) {
+            set_view_radius(radius);
+            g->max_radius = radius;
         }
         else {
             add_message("Viewing distance must be between 1 and 24.");
         }
     }
+    else if (sscanf(buffer, "/profile %255s", filename) == 1) {
+        if (profile_open(filename)) {
+            add_message("Writing frame profile.");
+        }
+        else {
+            add_message("Unable to open profile file.");
+        }
+    }
+    else if (strcmp(buffer, "/profile") == 0) {
+        profile_close();
+    }
+    else if (sscanf(buffer, "/lod %d", &radius) == 1) {
+        if (radius >= 0 && radius <= MAX_LOD_RADIUS) {
+            g->lod_radius = radius;
+            g->max_lod_radius = radius;
+        }
+        else {
+            add_message("LOD distance must be between 0 and 32.");
+        }
+    }
+    else if (sscanf(buffer, "/plants %d", &radius) == 1) {
+        if (radius >= 0 && radius <= 24) {
+            g->plant_radius = radius;
+            g->max_plant_radius = radius;
+        }
+        else {
+            add_message("Plant distance must be between 0 and 24.");
+        }
+    }
+    else if (sscanf(buffer, "/governor %d", &radius) == 1) {
+        if (radius >= 1) {
+            g->governor = 1;
+            g->governor_target = radius;
+            governor_reset();
+            add_message("Adjusting detail to hold the frame time.");
+        }
+        else {
+            add_message("Target frame time must be at least 1 ms.");
+        }
+    }
+    else if (strcmp(buffer, "/governor") == 0) {
+        g->governor = 0;
+        restore_detail();
+        add_message("Stopped adjusting detail.");
+    }
     else if (strcmp(buffer, "/copy") == 0) {
         copy();
     }
@@ -2140,6 +3542,31 @@ void parse_command(const char *buffer, int forward) {
     }
 }
 
+void queue_command(const char *buffer, int forward) {
+    if (g->command_count == MAX_COMMANDS) {
+        add_message("Too many pending commands.");
+        return;
+    }
+    int index = g->command_count++;
+    snprintf(g->commands[index], MAX_TEXT_LENGTH, "%s", buffer);
+    g->command_forward[index] = forward;
+    cnd_signal(&g->cnd);
+}
+
+void run_commands() {
+    while (g->command_count) {
+        char buffer[MAX_TEXT_LENGTH];
+        int forward = g->command_forward[0];
+        strncpy(buffer, g->commands[0], MAX_TEXT_LENGTH);
+        g->command_count--;
+        memmove(g->commands, g->commands + 1,
+            sizeof(g->commands[0]) * g->command_count);
+        memmove(g->command_forward, g->command_forward + 1,
+            sizeof(int) * g->command_count);
+        parse_command(buffer, forward);
+    }
+}
+
 void on_light() {
     State *s = &g->players->state;
     int hx, hy, hz;
@@ -2231,7 +3658,7 @@ void on_key(GLFWwindow *window, int key, int scancode, int action, int mods) {
                     }
                 }
                 else if (g->typing_buffer[0] == '/') {
-                    parse_command(g->typing_buffer, 1);
+                    queue_command(g->typing_buffer, 1);
                 }
                 else {
                     client_talk(g->typing_buffer);
@@ -2254,8 +3681,8 @@ void on_key(GLFWwindow *window, int key, int scancode, int action, int mods) {
             strncat(g->typing_buffer, buffer,
                 MAX_TEXT_LENGTH - strlen(g->typing_buffer) - 1);
         }
-        else {
-            parse_command(buffer, 0);
+        else if (buffer) {
+            queue_command(buffer, 0);
         }
     }
     if (!g->typing) {
@@ -2286,6 +3713,9 @@ void on_key(GLFWwindow *window, int key, int scancode, int action, int mods) {
         if (key == CRAFT_KEY_OBSERVE_INSET) {
             g->observe2 = (g->observe2 + 1) % g->player_count;
         }
+        if (key == CRAFT_KEY_PROFILE) {
+            g->show_profile = !g->show_profile;
+        }
     }
 }
 
@@ -2382,7 +3812,10 @@ void create_window() {
     int window_width = WINDOW_WIDTH;
     int window_height = WINDOW_HEIGHT;
     GLFWmonitor *monitor = NULL;
-    if (FULLSCREEN) {
+    if (g->benchmark) {
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+    }
+    else if (FULLSCREEN) {
         int mode_count;
         monitor = glfwGetPrimaryMonitor();
         const GLFWvidmode *modes = glfwGetVideoModes(monitor, &mode_count);
@@ -2491,6 +3924,7 @@ void parse_buffer(char *buffer) {
     State *s = &g->players->state;
     char *key;
     char *line = tokenize(buffer, "\n", &key);
+    int count = 0;
     while (line) {
         int pid;
         float ux, uy, uz, urx, ury;
@@ -2499,7 +3933,7 @@ void parse_buffer(char *buffer) {
         {
             me->id = pid;
             s->x = ux; s->y = uy; s->z = uz; s->rx = urx; s->ry = ury;
-            force_chunks(me);
+            prefetch_burst(me);
             if (uy == 0) {
                 s->y = highest_block(s->x, s->z) + 2;
             }
@@ -2508,7 +3942,10 @@ void parse_buffer(char *buffer) {
         if (sscanf(line, "B,%d,%d,%d,%d,%d,%d",
             &bp, &bq, &bx, &by, &bz, &bw) == 6)
         {
-            _set_block(bp, bq, bx, by, bz, bw, 0);
+            // older servers also send copies of edge blocks to neighbours
+            if (chunked(bx) == bp && chunked(bz) == bq) {
+                _set_block(bp, bq, bx, by, bz, bw, 0);
+            }
             if (player_intersects_block(2, s->x, s->y, s->z, bx, by, bz)) {
                 s->y = highest_block(s->x, s->z) + 2;
             }
@@ -2527,7 +3964,8 @@ void parse_buffer(char *buffer) {
                 player = g->players + g->player_count;
                 g->player_count++;
                 player->id = pid;
-                player->buffer = 0;
+                player->seen_valid = 0;
+                player->vx = player->vz = 0;
                 snprintf(player->name, MAX_NAME_LENGTH, "player%d", pid);
                 update_player(player, px, py, pz, prx, pry, 1); // twice
             }
@@ -2546,6 +3984,11 @@ void parse_buffer(char *buffer) {
             Chunk *chunk = find_chunk(kp, kq);
             if (chunk) {
                 dirty_chunk(chunk);
+                chunk->sign_dirty = 1;
+                // neighbours were meshed against the old edge blocks
+                if (chunk->edge_edits) {
+                    dirty_neighbors(kp, kq);
+                }
             }
         }
         double elapsed;
@@ -2554,6 +3997,9 @@ void parse_buffer(char *buffer) {
             glfwSetTime(fmod(elapsed, day_length));
             g->day_length = day_length;
             g->time_changed = 1;
+            for (int i = 0; i < g->player_count; i++) {
+                g->players[i].seen_valid = 0;
+            }
         }
         if (line[0] == 'T' && line[1] == ',') {
             char *text = line + 2;
@@ -2579,13 +4025,82 @@ void parse_buffer(char *buffer) {
         {
             _set_sign(bp, bq, bx, by, bz, face, text, 0);
         }
+        if (++count % 256 == 0) {
+            yield_model();
+        }
         line = tokenize(NULL, "\n", &key);
     }
 }
 
+int sim_run(void *arg) {
+    double last_commit = glfwGetTime();
+    double last_update = glfwGetTime();
+    double last_touch = glfwGetTime();
+    State *s = &g->players->state;
+    mtx_lock(&g->mtx);
+    while (g->sim_running) {
+        double now = glfwGetTime();
+        // the server can move the clock backwards
+        last_commit = MIN(last_commit, now);
+        last_update = MIN(last_update, now);
+        last_touch = MIN(last_touch, now);
+
+        // HANDLE DATA FROM SERVER //
+        profile_begin(PROFILE_NETWORK);
+        char *buffer = client_recv();
+        if (buffer) {
+            parse_buffer(buffer);
+            free(buffer);
+        }
+        profile_end(PROFILE_NETWORK);
+
+        // HANDLE COMMANDS //
+        run_commands();
+
+        // FLUSH DATABASE //
+        if (now - last_commit > COMMIT_INTERVAL) {
+            last_commit = now;
+            db_commit();
+        }
+        if (g->mode == MODE_ONLINE &&
+            now - last_touch > CACHE_TOUCH_INTERVAL)
+        {
+            last_touch = now;
+            touch_chunks();
+        }
+
+        // SEND POSITION TO SERVER //
+        if (now - last_update > 0.1) {
+            last_update = now;
+            client_position(s->x, s->y, s->z, s->rx, s->ry);
+        }
+
+        // MANAGE CHUNKS //
+        g->observe1 = g->observe1 % g->player_count;
+        g->observe2 = g->observe2 % g->player_count;
+        profile_begin(PROFILE_DELETE);
+        delete_chunks();
+        delete_lods();
+        profile_end(PROFILE_DELETE);
+        profile_begin(PROFILE_CHUNKS);
+        ensure_chunks(g->players + g->observe1, g->views);
+        if (g->observe2 && g->views[1].width) {
+            ensure_chunks(g->players + g->observe2, g->views + 1);
+        }
+        profile_end(PROFILE_CHUNKS);
+
+        // woken by the render thread once per frame or by a new command
+        cnd_wait(&g->cnd, &g->mtx);
+    }
+    mtx_unlock(&g->mtx);
+    return 0;
+}
+
 void reset_model() {
     memset(g->chunks, 0, sizeof(Chunk) * MAX_CHUNKS);
     g->chunk_count = 0;
+    g->cache_hits = 0;
+    g->cache_misses = 0;
     memset(g->players, 0, sizeof(Player) * MAX_PLAYERS);
     g->player_count = 0;
     g->observe1 = 0;
@@ -2606,6 +4121,10 @@ int main(int argc, char **argv) {
     curl_global_init(CURL_GLOBAL_DEFAULT);
     srand(time(NULL));
     rand();
+    g->benchmark = argc >= 2 && !strcmp(argv[1], "--benchmark");
+    if (g->benchmark) {
+        srand(1);
+    }
 
     // WINDOW INITIALIZATION //
     if (!glfwInit()) {
@@ -2628,6 +4147,14 @@ int main(int argc, char **argv) {
     if (glewInit() != GLEW_OK) {
         return -1;
     }
+    if (!GLEW_EXT_texture_array || !(GLEW_VERSION_3_0 ||
+        GLEW_ARB_framebuffer_object || GLEW_EXT_framebuffer_object))
+    {
+        fprintf(stderr, "Craft needs GL_EXT_texture_array and mipmap "
+            "generation (OpenGL 3.0 or GL_EXT_framebuffer_object)\n");
+        glfwTerminate();
+        return -1;
+    }
 
     glEnable(GL_CULL_FACE);
     glEnable(GL_DEPTH_TEST);
@@ -2638,10 +4165,13 @@ int main(int argc, char **argv) {
     GLuint texture;
     glGenTextures(1, &texture);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    load_png_texture("textures/texture.png");
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    glTexParameteri(
+        GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    load_png_texture_array("textures/texture.png", 16);
 
     GLuint font;
     glGenTextures(1, &font);
@@ -2671,11 +4201,14 @@ int main(int argc, char **argv) {
 
     // LOAD SHADERS //
     Attrib block_attrib = {0};
+    Attrib opaque_attrib = {0};
+    Attrib player_attrib = {0};
     Attrib line_attrib = {0};
     Attrib text_attrib = {0};
     Attrib sky_attrib = {0};
     CloudAttrib cloud_attrib = {0};
     GLuint program;
+    double shader_start = glfwGetTime();
 
     program = load_program(
         "shaders/block_vertex.glsl", "shaders/block_fragment.glsl");
@@ -2691,6 +4224,38 @@ int main(int argc, char **argv) {
     block_attrib.extra4 = glGetUniformLocation(program, "ortho");
     block_attrib.camera = glGetUniformLocation(program, "camera");
     block_attrib.timer = glGetUniformLocation(program, "timer");
+
+    program = load_program(
+        "shaders/block_vertex.glsl", "shaders/block_opaque_fragment.glsl");
+    opaque_attrib.program = program;
+    opaque_attrib.position = glGetAttribLocation(program, "position");
+    opaque_attrib.normal = glGetAttribLocation(program, "normal");
+    opaque_attrib.uv = glGetAttribLocation(program, "uv");
+    opaque_attrib.matrix = glGetUniformLocation(program, "matrix");
+    opaque_attrib.sampler = glGetUniformLocation(program, "sampler");
+    opaque_attrib.extra1 = glGetUniformLocation(program, "sky_sampler");
+    opaque_attrib.extra2 = glGetUniformLocation(program, "daylight");
+    opaque_attrib.extra3 = glGetUniformLocation(program, "fog_distance");
+    opaque_attrib.extra4 = glGetUniformLocation(program, "ortho");
+    opaque_attrib.camera = glGetUniformLocation(program, "camera");
+    opaque_attrib.timer = glGetUniformLocation(program, "timer");
+
+    program = load_program(
+        "shaders/player_vertex.glsl", "shaders/block_fragment.glsl");
+    player_attrib.program = program;
+    player_attrib.position = glGetAttribLocation(program, "position");
+    player_attrib.normal = glGetAttribLocation(program, "normal");
+    player_attrib.uv = glGetAttribLocation(program, "uv");
+    player_attrib.extra5 = glGetAttribLocation(program, "offset");
+    player_attrib.extra6 = glGetAttribLocation(program, "rotation");
+    player_attrib.matrix = glGetUniformLocation(program, "matrix");
+    player_attrib.sampler = glGetUniformLocation(program, "sampler");
+    player_attrib.extra1 = glGetUniformLocation(program, "sky_sampler");
+    player_attrib.extra2 = glGetUniformLocation(program, "daylight");
+    player_attrib.extra3 = glGetUniformLocation(program, "fog_distance");
+    player_attrib.extra4 = glGetUniformLocation(program, "ortho");
+    player_attrib.camera = glGetUniformLocation(program, "camera");
+    player_attrib.timer = glGetUniformLocation(program, "timer");
     
     program = load_program(
         "shaders/cloud_vertex.glsl", "shaders/cloud_fragment.glsl");
@@ -2731,9 +4296,22 @@ int main(int argc, char **argv) {
     sky_attrib.matrix = glGetUniformLocation(program, "matrix");
     sky_attrib.sampler = glGetUniformLocation(program, "sampler");
     sky_attrib.timer = glGetUniformLocation(program, "timer");
+    printf("Shader setup took %.1fms\n",
+        (glfwGetTime() - shader_start) * 1000);
+
+    // PLAYER MESH //
+    g->player_buffer = gen_player_buffer(0, 0, 0, 0, 0);
+    glGenBuffers(1, &g->player_instances);
 
     // CHECK COMMAND LINE ARGUMENTS //
-    if (argc == 2 || argc == 3) {
+    if (g->benchmark) {
+        g->mode = MODE_OFFLINE;
+        snprintf(g->benchmark_output, MAX_PATH_LENGTH,
+            "%s", argc >= 3 ? argv[2] : "benchmark.json");
+        snprintf(g->db_path, MAX_PATH_LENGTH,
+            "%s", argc >= 4 ? argv[3] : BENCHMARK_DB_PATH);
+    }
+    else if (argc == 2 || argc == 3) {
         g->mode = MODE_ONLINE;
         strncpy(g->server_addr, argv[1], MAX_ADDR_LENGTH);
         g->server_port = argc == 3 ? atoi(argv[2]) : DEFAULT_PORT;
@@ -2749,8 +4327,22 @@ int main(int argc, char **argv) {
     g->render_radius = RENDER_CHUNK_RADIUS;
     g->delete_radius = DELETE_CHUNK_RADIUS;
     g->sign_radius = RENDER_SIGN_RADIUS;
-
-    // INITIALIZE WORKER THREADS
+    g->plant_radius = PLANT_CHUNK_RADIUS;
+    g->max_plant_radius = PLANT_CHUNK_RADIUS;
+    g->show_profile = SHOW_PROFILE;
+    g->lod_radius = LOD_CHUNK_RADIUS;
+    g->governor = GOVERNOR;
+    g->governor_target = GOVERNOR_TARGET_MS;
+    g->max_radius = RENDER_CHUNK_RADIUS;
+    g->max_lod_radius = LOD_CHUNK_RADIUS;
+    g->cloud_limit = MAXIMUM_CLOUDS;
+    g->upload_budget_ms = UPLOAD_BUDGET_MS;
+    g->upload_budget_bytes = UPLOAD_BUDGET_BYTES;
+
+    // INITIALIZE THREADS //
+    mtx_init(&g->mtx, mtx_plain);
+    cnd_init(&g->cnd);
+    profile_init();
     for (int i = 0; i < WORKERS; i++) {
         Worker *worker = g->workers + i;
         worker->index = i;
@@ -2766,7 +4358,8 @@ int main(int argc, char **argv) {
         // DATABASE INITIALIZATION //
         if (g->mode == MODE_OFFLINE || USE_CACHE) {
             db_enable();
-            if (db_init(g->db_path)) {
+            db_cache_limit(g->mode == MODE_ONLINE ? CACHE_LIMIT_MB : 0);
+            if (db_init(g->db_path, WORKERS + 1)) {
                 return -1;
             }
             if (g->mode == MODE_ONLINE) {
@@ -2787,15 +4380,12 @@ int main(int argc, char **argv) {
         // LOCAL VARIABLES //
         reset_model();
         FPS fps = {0, 0, 0};
-        double last_commit = glfwGetTime();
-        double last_update = glfwGetTime();
         GLuint sky_buffer = gen_sky_buffer();
 
         Player *me = g->players;
         State *s = &g->players->state;
         me->id = 0;
         me->name[0] = '\0';
-        me->buffer = 0;
         g->player_count = 1;
 
         setup_base_items();
@@ -2803,18 +4393,37 @@ int main(int argc, char **argv) {
 
         if (SHOW_CLOUDS) {
             create_clouds();
+            set_cloud_limit(g->cloud_limit);
         }
 
         // LOAD STATE FROM DATABASE //
         int loaded = db_load_state(&s->x, &s->y, &s->z, &s->rx, &s->ry);
+        if (g->benchmark) {
+            loaded = benchmark_path(0, &s->x, &s->y, &s->z, &s->rx, &s->ry);
+        }
         force_chunks(me);
         if (!loaded) {
             s->y = highest_block(s->x, s->z) + 2;
         }
 
+        if (g->benchmark) {
+            g->benchmark_frame = 0;
+            benchmark_start();
+        }
+
+        // START SIMULATION THREAD //
+        g->scale = get_scale_factor();
+        glfwGetFramebufferSize(g->window, &g->width, &g->height);
+        snapshot_view(g->views, me, g->width, g->height, g->ortho, g->fov);
+        g->sim_running = 1;
+        thrd_create(&g->sim_thrd, sim_run, NULL);
+        db_assert_thread(1);
+
         // BEGIN MAIN LOOP //
         double previous = glfwGetTime();
         while (1) {
+            mtx_lock(&g->mtx);
+
             // WINDOW SIZE AND SCALE //
             g->scale = get_scale_factor();
             glfwGetFramebufferSize(g->window, &g->width, &g->height);
@@ -2823,76 +4432,121 @@ int main(int argc, char **argv) {
             // FRAME RATE //
             if (g->time_changed) {
                 g->time_changed = 0;
-                last_commit = glfwGetTime();
-                last_update = glfwGetTime();
                 memset(&fps, 0, sizeof(fps));
             }
             update_fps(&fps);
             double now = glfwGetTime();
             double dt = now - previous;
+            double frame_ms = dt * 1000;
             dt = MIN(dt, 0.2);
             dt = MAX(dt, 0.0);
             previous = now;
 
             // HANDLE MOUSE INPUT //
-            handle_mouse_input();
+            if (!g->benchmark) {
+                handle_mouse_input();
+            }
 
             // HANDLE MOVEMENT //
-            handle_movement(dt);
-
-            // HANDLE DATA FROM SERVER //
-            char *buffer = client_recv();
-            if (buffer) {
-                parse_buffer(buffer);
-                free(buffer);
+            profile_begin(PROFILE_MOVEMENT);
+            if (g->benchmark) {
+                if (g->benchmark_frame) {
+                    benchmark_frame(frame_ms, g->views->faces);
+                }
+                if (!benchmark_path(g->benchmark_frame++,
+                    &s->x, &s->y, &s->z, &s->rx, &s->ry))
+                {
+                    glfwSetWindowShouldClose(g->window, 1);
+                }
             }
-
-            // FLUSH DATABASE //
-            if (now - last_commit > COMMIT_INTERVAL) {
-                last_commit = now;
-                db_commit();
+            else {
+                handle_movement(dt);
             }
+            profile_end(PROFILE_MOVEMENT);
 
-            // SEND POSITION TO SERVER //
-            if (now - last_update > 0.1) {
-                last_update = now;
-                client_position(s->x, s->y, s->z, s->rx, s->ry);
-            }
+            // UPLOAD FINISHED MESHES //
+            profile_begin(PROFILE_UPLOAD);
+            del_dead_buffers();
+            int backlog = upload_chunks();
+            profile_end(PROFILE_UPLOAD);
+            update_governor(frame_ms, backlog);
 
             // PREPARE TO RENDER //
             g->observe1 = g->observe1 % g->player_count;
             g->observe2 = g->observe2 % g->player_count;
-            delete_chunks();
-            del_buffer(me->buffer);
-            me->buffer = gen_player_buffer(s->x, s->y, s->z, s->rx, s->ry);
             for (int i = 1; i < g->player_count; i++) {
                 interpolate_player(g->players + i);
             }
-            Player *player = g->players + g->observe1;
+            Snapshot *view = g->views;
+            snapshot_view(
+                view, g->players + g->observe1,
+                g->width, g->height, g->ortho, g->fov);
+            int pw = 256 * g->scale;
+            int ph = 256 * g->scale;
+            Snapshot *inset = 0;
+            if (g->observe2) {
+                inset = g->views + 1;
+                snapshot_view(
+                    inset, g->players + g->observe2, pw, ph, 0, 65);
+            }
+            char info[MAX_TEXT_LENGTH];
+            int hour = time_of_day() * 24;
+            char am_pm = hour < 12 ? 'a' : 'p';
+            hour = hour % 12;
+            hour = hour ? hour : 12;
+            snprintf(
+                info, MAX_TEXT_LENGTH,
+                "(%d, %d) (%.2f, %.2f, %.2f) [%d, %d, %d] %d%cm %dfps",
+                chunked(s->x), chunked(s->z), s->x, s->y, s->z,
+                g->player_count, g->chunk_count,
+                view->faces * 2, hour, am_pm, fps.fps);
+            char messages[MAX_MESSAGES][MAX_TEXT_LENGTH];
+            for (int i = 0; i < MAX_MESSAGES; i++) {
+                int index = (g->message_index + i) % MAX_MESSAGES;
+                memcpy(messages[i], g->messages[index], MAX_TEXT_LENGTH);
+            }
+            State *c = &view->state;
+
+            mtx_unlock(&g->mtx);
 
+            profile_begin(PROFILE_CLOUDS);
             if (SHOW_CLOUDS) {
-                update_clouds(s->x, s->y, s->z, s->rx, s->ry, g->fov);
+                update_clouds(c->x, c->y, c->z, c->rx, c->ry, view->fov);
             }
+            profile_end(PROFILE_CLOUDS);
 
             // RENDER 3-D SCENE //
             glClear(GL_COLOR_BUFFER_BIT);
             glClear(GL_DEPTH_BUFFER_BIT);
-            render_sky(&sky_attrib, player, sky_buffer);
+            profile_begin(PROFILE_SKY);
+            render_sky(&sky_attrib, view, sky_buffer);
+            profile_end(PROFILE_SKY);
             glClear(GL_DEPTH_BUFFER_BIT);
-            int face_count = render_chunks(&block_attrib, player);
-            render_signs(&text_attrib, player);
-            render_sign(&text_attrib, player);
-            render_players(&block_attrib, player);
+            profile_begin(PROFILE_RENDER_CHUNKS);
+            render_chunks(&opaque_attrib, &block_attrib, view);
+            profile_end(PROFILE_RENDER_CHUNKS);
+            profile_begin(PROFILE_SIGNS);
+            render_signs(&text_attrib, view);
+            render_sign(&text_attrib, view);
+            profile_end(PROFILE_SIGNS);
+            profile_begin(PROFILE_PLAYERS);
+            render_players(&player_attrib, view);
+            profile_end(PROFILE_PLAYERS);
+            profile_begin(PROFILE_HUD);
             if (SHOW_WIREFRAME) {
-                render_wireframe(&line_attrib, player);
+                render_wireframe(&line_attrib, view);
             }
+            profile_end(PROFILE_HUD);
 
+            profile_begin(PROFILE_CLOUDS);
             if (SHOW_CLOUDS) {
                 cloud_attrib.time = time_of_day();
-                render_clouds(&cloud_attrib, g->width, g->height, s->x, s->y, s->z, s->rx, s->ry, g->fov, g->ortho, g->render_radius);
+                render_clouds(&cloud_attrib, view->matrix, c->x, c->y, c->z, c->ry);
             }
+            profile_end(PROFILE_CLOUDS);
 
             // RENDER HUD //
+            profile_begin(PROFILE_HUD);
             glClear(GL_DEPTH_BUFFER_BIT);
             if (SHOW_CROSSHAIRS) {
                 render_crosshairs(&line_attrib);
@@ -2907,25 +4561,14 @@ int main(int argc, char **argv) {
             float tx = ts / 2;
             float ty = g->height - ts;
             if (SHOW_INFO_TEXT) {
-                int hour = time_of_day() * 24;
-                char am_pm = hour < 12 ? 'a' : 'p';
-                hour = hour % 12;
-                hour = hour ? hour : 12;
-                snprintf(
-                    text_buffer, 1024,
-                    "(%d, %d) (%.2f, %.2f, %.2f) [%d, %d, %d] %d%cm %dfps",
-                    chunked(s->x), chunked(s->z), s->x, s->y, s->z,
-                    g->player_count, g->chunk_count,
-                    face_count * 2, hour, am_pm, fps.fps);
-                render_text(&text_attrib, ALIGN_LEFT, tx, ty, ts, text_buffer);
+                render_text(&text_attrib, ALIGN_LEFT, tx, ty, ts, info);
                 ty -= ts * 2;
             }
             if (SHOW_CHAT_TEXT) {
                 for (int i = 0; i < MAX_MESSAGES; i++) {
-                    int index = (g->message_index + i) % MAX_MESSAGES;
-                    if (strlen(g->messages[index])) {
+                    if (strlen(messages[i])) {
                         render_text(&text_attrib, ALIGN_LEFT, tx, ty, ts,
-                            g->messages[index]);
+                            messages[i]);
                         ty -= ts * 2;
                     }
                 }
@@ -2936,24 +4579,61 @@ int main(int argc, char **argv) {
                 ty -= ts * 2;
             }
             if (SHOW_PLAYER_NAMES) {
-                if (player != me) {
+                if (view->name[0]) {
                     render_text(&text_attrib, ALIGN_CENTER,
-                        g->width / 2, ts, ts, player->name);
+                        g->width / 2, ts, ts, view->name);
                 }
-                Player *other = player_crosshair(player);
-                if (other) {
+                if (view->target[0]) {
                     render_text(&text_attrib, ALIGN_CENTER,
                         g->width / 2, g->height / 2 - ts - 24, ts,
-                        other->name);
+                        view->target);
+                }
+            }
+            if (g->show_profile) {
+                ProfileFrame *pf = profile_average();
+                snprintf(
+                    text_buffer, 1024, "frame %.2fms %d draws %d uploads %dkb",
+                    pf->frame_ms, pf->draw_calls, pf->uploads,
+                    pf->upload_bytes / 1024);
+                render_text(&text_attrib, ALIGN_LEFT, tx, ty, ts, text_buffer);
+                ty -= ts * 2;
+                snprintf(
+                    text_buffer, 1024, "upload backlog %d overruns %d/s",
+                    pf->backlog, pf->overruns);
+                render_text(&text_attrib, ALIGN_LEFT, tx, ty, ts, text_buffer);
+                ty -= ts * 2;
+                int coalesced;
+                double rows_per_second;
+                db_write_stats(&coalesced, &rows_per_second);
+                snprintf(
+                    text_buffer, 1024, "db writes %.0f rows/s %d coalesced",
+                    rows_per_second, coalesced);
+                render_text(&text_attrib, ALIGN_LEFT, tx, ty, ts, text_buffer);
+                ty -= ts * 2;
+                int lookups = g->cache_hits + g->cache_misses;
+                snprintf(
+                    text_buffer, 1024, "chunk cache %d%% hits %d chunks %dMB",
+                    lookups ? g->cache_hits * 100 / lookups : 0,
+                    g->cached_count, g->cached_bytes / (1024 * 1024));
+                render_text(&text_attrib, ALIGN_LEFT, tx, ty, ts, text_buffer);
+                ty -= ts * 2;
+                snprintf(
+                    text_buffer, 1024, "cold chunks %d %dKB",
+                    g->cold_count, g->cold_bytes / 1024);
+                render_text(&text_attrib, ALIGN_LEFT, tx, ty, ts, text_buffer);
+                ty -= ts * 2;
+                for (int i = 0; i < PROFILE_STAGES; i++) {
+                    snprintf(text_buffer, 1024, "%-8s %.2fms",
+                        profile_name(i), pf->ms[i]);
+                    render_text(
+                        &text_attrib, ALIGN_LEFT, tx, ty, ts, text_buffer);
+                    ty -= ts * 2;
                 }
             }
+            profile_end(PROFILE_HUD);
 
             // RENDER PICTURE IN PICTURE //
-            if (g->observe2) {
-                player = g->players + g->observe2;
-
-                int pw = 256 * g->scale;
-                int ph = 256 * g->scale;
+            if (inset) {
                 int offset = 32 * g->scale;
                 int pad = 3 * g->scale;
                 int sw = pw + pad * 2;
@@ -2968,49 +4648,79 @@ int main(int argc, char **argv) {
 
                 g->width = pw;
                 g->height = ph;
-                g->ortho = 0;
-                g->fov = 65;
 
-                render_sky(&sky_attrib, player, sky_buffer);
+                profile_begin(PROFILE_SKY);
+                render_sky(&sky_attrib, inset, sky_buffer);
+                profile_end(PROFILE_SKY);
                 glClear(GL_DEPTH_BUFFER_BIT);
-                render_chunks(&block_attrib, player);
-                render_signs(&text_attrib, player);
-                render_players(&block_attrib, player);
+                profile_begin(PROFILE_RENDER_CHUNKS);
+                render_chunks(&opaque_attrib, &block_attrib, inset);
+                profile_end(PROFILE_RENDER_CHUNKS);
+                profile_begin(PROFILE_SIGNS);
+                render_signs(&text_attrib, inset);
+                profile_end(PROFILE_SIGNS);
+                profile_begin(PROFILE_PLAYERS);
+                render_players(&player_attrib, inset);
+                profile_end(PROFILE_PLAYERS);
                 glClear(GL_DEPTH_BUFFER_BIT);
                 if (SHOW_PLAYER_NAMES) {
                     render_text(&text_attrib, ALIGN_CENTER,
-                        pw / 2, ts, ts, player->name);
+                        pw / 2, ts, ts, inset->name);
                 }
             }
 
             // SWAP AND POLL //
             glfwSwapBuffers(g->window);
+            mtx_lock(&g->mtx);
             glfwPollEvents();
+            int mode_changed = g->mode_changed;
+            g->mode_changed = 0;
+            cnd_signal(&g->cnd);
+            mtx_unlock(&g->mtx);
+            profile_frame(frame_ms);
             if (glfwWindowShouldClose(g->window)) {
                 running = 0;
                 break;
             }
-            if (g->mode_changed) {
-                g->mode_changed = 0;
+            if (mode_changed) {
                 break;
             }
         }
 
+        // STOP SIMULATION THREAD //
+        db_assert_thread(0);
+        mtx_lock(&g->mtx);
+        g->sim_running = 0;
+        cnd_signal(&g->cnd);
+        mtx_unlock(&g->mtx);
+        thrd_join(g->sim_thrd, NULL);
+
         // SHUTDOWN //
         clua_close();
         if (SHOW_CLOUDS) {
             cleanup_clouds();
         }
-        db_save_state(s->x, s->y, s->z, s->rx, s->ry);
+        if (g->benchmark) {
+            benchmark_write(
+                g->benchmark_output, (const char *)glGetString(GL_RENDERER));
+        }
+        else {
+            db_save_state(s->x, s->y, s->z, s->rx, s->ry);
+        }
         db_close();
         db_disable();
         client_stop();
         client_disable();
         del_buffer(sky_buffer);
         delete_all_chunks();
+        delete_all_lods();
         delete_all_players();
+        del_dead_buffers();
     }
 
+    del_buffer(g->player_buffer);
+    del_buffer(g->player_instances);
+    profile_close();
     glfwTerminate();
     curl_global_cleanup();
     return 0;
@@ -0,0 +1,144 @@
+#include <GLFW/glfw3.h>
+#include <stdio.h>
+#include <string.h>
+#include "profile.h"
+#include "tinycthread.h"
+
+static const char *names[PROFILE_STAGES] = {
+    "movement",
+    "network",
+    "chunks",
+    "delete",
+    "upload",
+    "sky",
+    "render",
+    "signs",
+    "players",
+    "clouds",
+    "hud"
+};
+
+static double starts[PROFILE_STAGES];
+static ProfileFrame current;
+static ProfileFrame total;
+static ProfileFrame average;
+static int frames;
+static double window_start;
+static FILE *csv;
+static int csv_frame;
+static mtx_t mtx;
+
+void profile_init() {
+    mtx_init(&mtx, mtx_plain);
+}
+
+// stages are timed on both the render and the simulation thread, but
+// each stage is only ever timed by one of them
+void profile_begin(int stage) {
+    starts[stage] = glfwGetTime();
+}
+
+void profile_end(int stage) {
+    double ms = (glfwGetTime() - starts[stage]) * 1000;
+    mtx_lock(&mtx);
+    current.ms[stage] += ms;
+    mtx_unlock(&mtx);
+}
+
+void profile_draw(int count) {
+    mtx_lock(&mtx);
+    current.draw_calls += count;
+    mtx_unlock(&mtx);
+}
+
+void profile_upload(int bytes) {
+    mtx_lock(&mtx);
+    current.uploads++;
+    current.upload_bytes += bytes;
+    mtx_unlock(&mtx);
+}
+
+void profile_backlog(int backlog, int overrun) {
+    mtx_lock(&mtx);
+    current.backlog = backlog;
+    current.overruns += overrun;
+    mtx_unlock(&mtx);
+}
+
+void profile_frame(double frame_ms) {
+    mtx_lock(&mtx);
+    current.frame_ms = frame_ms;
+    if (csv) {
+        fprintf(csv, "%d,%.3f", csv_frame++, current.frame_ms);
+        for (int i = 0; i < PROFILE_STAGES; i++) {
+            fprintf(csv, ",%.3f", current.ms[i]);
+        }
+        fprintf(csv, ",%d,%d,%d,%d,%d\n",
+            current.draw_calls, current.uploads, current.upload_bytes,
+            current.backlog, current.overruns);
+    }
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+        total.ms[i] += current.ms[i];
+    }
+    total.frame_ms += current.frame_ms;
+    total.draw_calls += current.draw_calls;
+    total.uploads += current.uploads;
+    total.upload_bytes += current.upload_bytes;
+    total.backlog += current.backlog;
+    total.overruns += current.overruns;
+    frames++;
+    memset(&current, 0, sizeof(current));
+    mtx_unlock(&mtx);
+    double now = glfwGetTime();
+    if (now - window_start < 1) {
+        return;
+    }
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+        average.ms[i] = total.ms[i] / frames;
+    }
+    average.frame_ms = total.frame_ms / frames;
+    average.draw_calls = total.draw_calls / frames;
+    average.uploads = total.uploads / frames;
+    average.upload_bytes = total.upload_bytes / frames;
+    average.backlog = total.backlog / frames;
+    // overruns are reported per averaging window rather than per frame
+    average.overruns = total.overruns;
+    memset(&total, 0, sizeof(total));
+    frames = 0;
+    window_start = now;
+}
+
+ProfileFrame *profile_average() {
+    return &average;
+}
+
+const char *profile_name(int stage) {
+    return names[stage];
+}
+
+int profile_open(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return 0;
+    }
+    fprintf(file, "frame,frame_ms");
+    for (int i = 0; i < PROFILE_STAGES; i++) {
+        fprintf(file, ",%s_ms", names[i]);
+    }
+    fprintf(file, ",draw_calls,uploads,upload_bytes,backlog,overruns\n");
+    profile_close();
+    mtx_lock(&mtx);
+    csv = file;
+    csv_frame = 0;
+    mtx_unlock(&mtx);
+    return 1;
+}
+
+void profile_close() {
+    mtx_lock(&mtx);
+    if (csv) {
+        fclose(csv);
+        csv = 0;
+    }
+    mtx_unlock(&mtx);
+}
@@ -0,0 +1,39 @@
+#ifndef _profile_h_
+#define _profile_h_
+
+#define PROFILE_MOVEMENT 0
+#define PROFILE_NETWORK 1
+#define PROFILE_CHUNKS 2
+#define PROFILE_DELETE 3
+#define PROFILE_UPLOAD 4
+#define PROFILE_SKY 5
+#define PROFILE_RENDER_CHUNKS 6
+#define PROFILE_SIGNS 7
+#define PROFILE_PLAYERS 8
+#define PROFILE_CLOUDS 9
+#define PROFILE_HUD 10
+#define PROFILE_STAGES 11
+
+typedef struct {
+    double ms[PROFILE_STAGES];
+    double frame_ms;
+    int draw_calls;
+    int uploads;
+    int upload_bytes;
+    int backlog;
+    int overruns;
+} ProfileFrame;
+
+void profile_init();
+void profile_begin(int stage);
+void profile_end(int stage);
+void profile_draw(int count);
+void profile_upload(int bytes);
+void profile_backlog(int backlog, int overrun);
+void profile_frame(double frame_ms);
+ProfileFrame *profile_average();
+const char *profile_name(int stage);
+int profile_open(const char *path);
+void profile_close();
+
+#endif
@@ -5,6 +5,11 @@ typedef enum {
     BLOCK,
     LIGHT,
     KEY,
+    SIGN,
+    DELETE_SIGN,
+    DELETE_SIGNS,
+    GET_KEY,
+    TOUCH,
     COMMIT,
     EXIT
 } RingEntryType;
@@ -18,6 +23,8 @@ typedef struct {
     int z;
     int w;
     int key;
+    char *text;
+    void (*callback)(int p, int q, int key);
 } RingEntry;
 
 typedef struct {
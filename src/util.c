@@ -3,6 +3,7 @@
 #include <stdlib.h>
 #include "lodepng.h"
 #include "matrix.h"
+#include "profile.h"
 #include "util.h"
 
 int rand_int(int n) {
@@ -28,6 +29,9 @@ void update_fps(FPS *fps) {
 
 char *load_file(const char *path) {
     FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
     fseek(file, 0, SEEK_END);
     int length = ftell(file);
     rewind(file);
@@ -43,6 +47,7 @@ GLuint gen_buffer(GLsizei size, GLfloat *data) {
     glBindBuffer(GL_ARRAY_BUFFER, buffer);
     glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
+    profile_upload(size);
     return buffer;
 }
 
@@ -93,6 +98,10 @@ GLuint make_program(GLuint shader1, GLuint shader2) {
     GLuint program = glCreateProgram();
     glAttachShader(program, shader1);
     glAttachShader(program, shader2);
+    if (USE_SHADER_CACHE && GLEW_ARB_get_program_binary) {
+        glProgramParameteri(
+            program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(program);
     GLint status;
     glGetProgramiv(program, GL_LINK_STATUS, &status);
@@ -111,10 +120,104 @@ GLuint make_program(GLuint shader1, GLuint shader2) {
     return program;
 }
 
+static unsigned long long hash_string(
+    unsigned long long hash, const char *str)
+{
+    // FNV-1a, including the terminating zero so "ab" + "c" != "a" + "bc"
+    do {
+        hash ^= (unsigned char)*str;
+        hash *= 1099511628211ULL;
+    } while (*str++);
+    return hash;
+}
+
+// linked programs are cached per source and driver, so a driver update
+// or an edited shader simply misses the cache
+static void program_cache_path(
+    char *path, int length, const char *source1, const char *source2)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    hash = hash_string(hash, source1);
+    hash = hash_string(hash, source2);
+    hash = hash_string(hash, (const char *)glGetString(GL_VENDOR));
+    hash = hash_string(hash, (const char *)glGetString(GL_RENDERER));
+    hash = hash_string(hash, (const char *)glGetString(GL_VERSION));
+    snprintf(path, length, "cache.%016llx.program", hash);
+}
+
+static GLuint load_program_binary(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file) - (long)sizeof(GLenum);
+    rewind(file);
+    GLenum format;
+    GLuint program = 0;
+    void *data = length > 0 ? malloc(length) : 0;
+    if (data && fread(&format, sizeof(format), 1, file) == 1 &&
+        fread(data, 1, length, file) == (size_t)length)
+    {
+        program = glCreateProgram();
+        glProgramBinary(program, format, data, length);
+        GLint status;
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (status == GL_FALSE) {
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+    free(data);
+    fclose(file);
+    return program;
+}
+
+static void save_program_binary(const char *path, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    void *data = malloc(length);
+    GLenum format;
+    glGetProgramBinary(program, length, &length, &format, data);
+    FILE *file = fopen(path, "wb");
+    if (file) {
+        fwrite(&format, sizeof(format), 1, file);
+        fwrite(data, 1, length, file);
+        fclose(file);
+    }
+    free(data);
+}
+
 GLuint load_program(const char *path1, const char *path2) {
-    GLuint shader1 = load_shader(GL_VERTEX_SHADER, path1);
-    GLuint shader2 = load_shader(GL_FRAGMENT_SHADER, path2);
-    GLuint program = make_program(shader1, shader2);
+    char *source1 = load_file(path1);
+    char *source2 = load_file(path2);
+    if (!source1 || !source2) {
+        fprintf(stderr, "error: unable to load program %s, %s\n",
+            path1, path2);
+        free(source1);
+        free(source2);
+        return 0;
+    }
+    int cache = USE_SHADER_CACHE && GLEW_ARB_get_program_binary;
+    char path[64];
+    GLuint program = 0;
+    if (cache) {
+        program_cache_path(path, sizeof(path), source1, source2);
+        program = load_program_binary(path);
+    }
+    if (!program) {
+        GLuint shader1 = make_shader(GL_VERTEX_SHADER, source1);
+        GLuint shader2 = make_shader(GL_FRAGMENT_SHADER, source2);
+        program = make_program(shader1, shader2);
+        if (cache) {
+            save_program_binary(path, program);
+        }
+    }
+    free(source1);
+    free(source2);
     return program;
 }
 
@@ -147,6 +250,65 @@ void load_png_texture(const char *file_name) {
     free(data);
 }
 
+// splits a square atlas of columns x columns tiles into the layers of the
+// bound GL_TEXTURE_2D_ARRAY and builds its mipmaps (the caller checks for
+// GL_EXT_texture_array and mipmap generation support); magenta texels become
+// transparent and take the tile's average color so they don't bleed into
+// the smaller mip levels
+void load_png_texture_array(const char *file_name, int columns) {
+    unsigned int error;
+    unsigned char *data;
+    unsigned int width, height;
+    error = lodepng_decode32_file(&data, &width, &height, file_name);
+    if (error) {
+        fprintf(stderr, "error %u: Unable to load texture %s: %s\n", error, file_name, lodepng_error_text(error));
+        return;
+    }
+    flip_image_vertical(data, width, height);
+    int tw = width / columns;
+    int th = height / columns;
+    int layers = columns * columns;
+    unsigned char *tiles = malloc(tw * th * 4 * layers);
+    for (int t = 0; t < layers; t++) {
+        unsigned char *tile = tiles + t * tw * th * 4;
+        int tx = (t % columns) * tw;
+        int ty = (t / columns) * th;
+        for (int y = 0; y < th; y++) {
+            memcpy(tile + y * tw * 4,
+                data + ((ty + y) * width + tx) * 4, tw * 4);
+        }
+        int sum[3] = {0};
+        int count = 0;
+        for (int i = 0; i < tw * th; i++) {
+            unsigned char *c = tile + i * 4;
+            if (c[0] == 255 && c[1] == 0 && c[2] == 255) {
+                continue;
+            }
+            sum[0] += c[0]; sum[1] += c[1]; sum[2] += c[2];
+            count++;
+        }
+        for (int i = 0; i < tw * th; i++) {
+            unsigned char *c = tile + i * 4;
+            if (c[0] == 255 && c[1] == 0 && c[2] == 255) {
+                c[0] = count ? sum[0] / count : 0;
+                c[1] = count ? sum[1] / count : 0;
+                c[2] = count ? sum[2] / count : 0;
+                c[3] = 0;
+            }
+        }
+    }
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, tw, th, layers, 0, GL_RGBA,
+        GL_UNSIGNED_BYTE, tiles);
+    if (GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object) {
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+    else {
+        glGenerateMipmapEXT(GL_TEXTURE_2D_ARRAY);
+    }
+    free(tiles);
+    free(data);
+}
+
 char *tokenize(char *str, const char *delim, char **key) {
     char *result;
     if (str == NULL) {
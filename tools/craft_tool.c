@@ -0,0 +1,248 @@
+// Maintenance commands for world databases, written by the client or by
+// server.py, that are too slow to run row by row from Python.
+//
+//     cmake . && make craft_tool
+//     ./craft_tool compact [-j THREADS] [-s SEED] [--vacuum] DATABASE
+//
+// compact regenerates the terrain of every chunk on a pool of threads and
+// deletes the block rows it makes redundant: rows equal to the generated
+// terrain and copies of neighbouring chunks' edge blocks. Zero light rows
+// are dropped as well. Stop the server or client using the file first.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "config.h"
+#include "item.h"
+#include "map.h"
+#include "noise.h"
+#include "sqlite3.h"
+#include "tinycthread.h"
+#include "world.h"
+
+typedef struct {
+    sqlite3_int64 *rowids;
+    int count;
+    int capacity;
+    int rows;
+    int copies;
+    int generated;
+} Result;
+
+typedef struct {
+    thrd_t thrd;
+    const char *path;
+    Result result;
+} Worker;
+
+static int *chunks;
+static int chunk_count;
+static int next_chunk;
+static sqlite3_int64 last_rowid;
+static mtx_t mtx;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int chunked(int x) {
+    return x < 0 ? (x + 1) / CHUNK_SIZE - 1 : x / CHUNK_SIZE;
+}
+
+static void map_set_func(int x, int y, int z, int w, void *arg) {
+    map_set((Map *)arg, x, y, z, w);
+}
+
+static void add_rowid(Result *result, sqlite3_int64 rowid) {
+    if (result->count == result->capacity) {
+        result->capacity = result->capacity ? result->capacity * 2 : 1024;
+        result->rowids = realloc(
+            result->rowids, sizeof(sqlite3_int64) * result->capacity);
+    }
+    result->rowids[result->count++] = rowid;
+}
+
+static void compact_chunk(Result *result, sqlite3_stmt *stmt, int p, int q) {
+    Map map;
+    map_alloc(&map, p * CHUNK_SIZE - 1, 0, q * CHUNK_SIZE - 1, 0x7fff);
+    create_world(p, q, map_set_func, &map);
+    sqlite3_reset(stmt);
+    sqlite3_bind_int(stmt, 1, p);
+    sqlite3_bind_int(stmt, 2, q);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        sqlite3_int64 rowid = sqlite3_column_int64(stmt, 0);
+        int x = sqlite3_column_int(stmt, 1);
+        int y = sqlite3_column_int(stmt, 2);
+        int z = sqlite3_column_int(stmt, 3);
+        int w = sqlite3_column_int(stmt, 4);
+        result->rows++;
+        // clients sync from the highest rowid, it must not be reused
+        if (rowid == last_rowid) {
+            continue;
+        }
+        if (chunked(x) != p || chunked(z) != q) {
+            add_rowid(result, rowid);
+            result->copies++;
+        }
+        else if (map_get(&map, x, y, z) == w) {
+            add_rowid(result, rowid);
+            result->generated++;
+        }
+    }
+    map_free(&map);
+}
+
+static int worker_run(void *arg) {
+    Worker *worker = (Worker *)arg;
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    if (sqlite3_open_v2(
+        worker->path, &db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL))
+    {
+        return 1;
+    }
+    sqlite3_prepare_v2(db,
+        "select rowid, x, y, z, w from block where p = ? and q = ?;",
+        -1, &stmt, NULL);
+    while (1) {
+        mtx_lock(&mtx);
+        int index = next_chunk++;
+        mtx_unlock(&mtx);
+        if (index >= chunk_count) {
+            break;
+        }
+        compact_chunk(
+            &worker->result, stmt, chunks[index * 2], chunks[index * 2 + 1]);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_close(db);
+    return 0;
+}
+
+static void load_chunks(sqlite3 *db) {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(db, "select max(rowid) from block;", -1, &stmt, NULL);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        last_rowid = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    int capacity = 1024;
+    chunks = malloc(sizeof(int) * 2 * capacity);
+    sqlite3_prepare_v2(db, "select distinct p, q from block;", -1, &stmt, NULL);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (chunk_count == capacity) {
+            capacity *= 2;
+            chunks = realloc(chunks, sizeof(int) * 2 * capacity);
+        }
+        chunks[chunk_count * 2] = sqlite3_column_int(stmt, 0);
+        chunks[chunk_count * 2 + 1] = sqlite3_column_int(stmt, 1);
+        chunk_count++;
+    }
+    sqlite3_finalize(stmt);
+}
+
+static int compact(const char *path, int threads, int vacuum) {
+    double start = now();
+    sqlite3 *db;
+    if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READWRITE, NULL)) {
+        fprintf(stderr, "Unable to open %s\n", path);
+        return 1;
+    }
+    sqlite3_busy_timeout(db, 5000);
+    load_chunks(db);
+    setup_base_items();
+    mtx_init(&mtx, mtx_plain);
+    Worker *workers = calloc(threads, sizeof(Worker));
+    for (int i = 0; i < threads; i++) {
+        workers[i].path = path;
+        thrd_create(&workers[i].thrd, worker_run, workers + i);
+    }
+    // the readers are all closed before writing so the commit can't be busy
+    for (int i = 0; i < threads; i++) {
+        thrd_join(workers[i].thrd, NULL);
+    }
+    Result total = {0};
+    sqlite3_stmt *stmt;
+    sqlite3_exec(db, "begin;", NULL, NULL, NULL);
+    sqlite3_prepare_v2(
+        db, "delete from block where rowid = ?;", -1, &stmt, NULL);
+    for (int i = 0; i < threads; i++) {
+        Result *result = &workers[i].result;
+        for (int j = 0; j < result->count; j++) {
+            sqlite3_reset(stmt);
+            sqlite3_bind_int64(stmt, 1, result->rowids[j]);
+            sqlite3_step(stmt);
+        }
+        total.rows += result->rows;
+        total.copies += result->copies;
+        total.generated += result->generated;
+        free(result->rowids);
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_exec(db, "delete from light where w = 0;", NULL, NULL, NULL);
+    int lights = sqlite3_changes(db);
+    int rc = sqlite3_exec(db, "commit;", NULL, NULL, NULL);
+    if (rc) {
+        fprintf(stderr, "%s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return 1;
+    }
+    sqlite3_exec(db, "reindex;", NULL, NULL, NULL);
+    if (vacuum) {
+        sqlite3_exec(db, "vacuum;", NULL, NULL, NULL);
+    }
+    sqlite3_close(db);
+    free(workers);
+    free(chunks);
+    printf("%d chunks, %d block rows\n", chunk_count, total.rows);
+    printf("Removed %d border copies and %d rows matching the terrain\n",
+        total.copies, total.generated);
+    printf("Removed %d empty light rows\n", lights);
+    printf("Took %.1fs on %d threads\n", now() - start, threads);
+    return 0;
+}
+
+static void usage() {
+    fprintf(stderr,
+        "Usage: craft_tool compact [-j THREADS] [-s SEED] [--vacuum] "
+        "DATABASE\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2 || strcmp(argv[1], "compact")) {
+        usage();
+        return 1;
+    }
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int vacuum = 0;
+    const char *path = 0;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            seed(atoi(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--vacuum")) {
+            vacuum = 1;
+        }
+        else if (!path) {
+            path = argv[i];
+        }
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (!path) {
+        usage();
+        return 1;
+    }
+    return compact(path, threads > 0 ? threads : 1, vacuum);
+}